@@ -0,0 +1,53 @@
+#include <alloc_counter.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <cstddef>
+
+// Replaces the global operator new and delete, so that every heap allocation in the program is counted
+
+namespace Chomp {
+	namespace alloc_counter {
+		static std::atomic<uint64_t> allocations{0};
+
+		uint64_t count() {
+			return allocations.load(std::memory_order_relaxed);
+		}
+
+		static void* allocate(std::size_t size, std::size_t alignment) {
+			allocations.fetch_add(1, std::memory_order_relaxed);
+
+			if (size == 0) size = 1;
+
+			void* p = (alignment <= alignof(std::max_align_t)) ? std::malloc(size)
+			          : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+			if (!p) throw std::bad_alloc();
+
+			return p;
+		}
+	}
+}
+
+void* operator new(std::size_t size) {
+	return Chomp::alloc_counter::allocate(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return Chomp::alloc_counter::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
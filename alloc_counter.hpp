@@ -0,0 +1,13 @@
+#ifndef CHOMP_ALLOC_COUNTER_H
+#define CHOMP_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+namespace Chomp {
+	namespace alloc_counter {
+		// Number of heap allocations (calls to operator new) made by the whole program so far
+		uint64_t count();
+	}
+}
+
+#endif //CHOMP_ALLOC_COUNTER_H
@@ -0,0 +1,166 @@
+#include <analytics.hpp>
+#include <batch.hpp>
+#include <datastructs.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace Chomp {
+	namespace analytics {
+		static void count(std::vector<uint64_t>& histogram, int value, int multiplicity) {
+			// Anything else is a broken lookup, and would make a histogram of billions of bins
+			if (value < 0 || value > UINT16_MAX) throw std::runtime_error(FILE_LINE"Histogram value out of range");
+			if ((size_t) value >= histogram.size()) histogram.resize(value + 1);
+
+			histogram[value] += multiplicity;
+		}
+
+		static void merge_histogram(std::vector<uint64_t>& into, const std::vector<uint64_t>& from) {
+			if (into.size() < from.size()) into.resize(from.size());
+
+			for (size_t i = 0; i < from.size(); ++i)
+				into[i] += from[i];
+		}
+
+		void LevelHistogram::add(const Position& p, int multiplicity) {
+			PositionInfo info = p.info();
+
+			positions += multiplicity;
+			if (!info.is_winning) losing += multiplicity;
+
+			count(dte, info.dte, multiplicity);
+			count(winning_cuts, info.is_winning ? p.num_winning_cuts() : 0, multiplicity);
+
+			// The flipped position swaps height and width
+			int h = p.get_height(), w = p.get_width();
+			count(height, h, 1);
+			count(width, w, 1);
+
+			if (multiplicity == 2) {
+				count(height, w, 1);
+				count(width, h, 1);
+			}
+		}
+
+		void LevelHistogram::merge(const LevelHistogram& other) {
+			positions += other.positions;
+			losing += other.losing;
+
+			merge_histogram(dte, other.dte);
+			merge_histogram(winning_cuts, other.winning_cuts);
+			merge_histogram(height, other.height);
+			merge_histogram(width, other.width);
+		}
+
+		std::vector<LevelHistogram> analyze(int max_squares, int bound_width, int bound_height) {
+			const unsigned POSITION_BATCH_SIZE = 1000000;
+			const int NUM_THREADS = 8;
+
+			// No position with n squares is wider or taller than n
+			auto widest = [&] (int bound) { return (bound < 0) ? max_squares : std::min(bound, max_squares); };
+
+			SolvedRegion region = answered_region();
+			if (!region.contains(max_squares, widest(bound_width), widest(bound_height)))
+				throw std::runtime_error(FILE_LINE"Analyzed region outside the solved tables");
+			if (!region.has_dte) throw std::runtime_error(FILE_LINE"Analytics need tables solved with dtes");
+
+			datastructs::WorkerPool pool(NUM_THREADS);
+			std::vector<LevelHistogram> worker_histograms(NUM_THREADS);
+			std::vector<LevelHistogram> levels;
+
+			PositionBatch positions;
+
+			auto process_positions = [&] () {
+				size_t positions_per_worker = positions.size() / NUM_THREADS;
+
+				auto work = [&] (int worker) {
+					auto begin = positions.begin() + worker * positions_per_worker;
+					auto end = (worker == NUM_THREADS - 1) ? positions.end() : (begin + positions_per_worker);
+
+					for (auto it = begin; it != end; ++it) {
+						PositionView p = *it;
+						worker_histograms[worker].add(p.to_position(), (p.o == Orientation::CANONICAL) ? 2 : 1);
+					}
+				};
+
+				pool.run(work);
+				positions.clear();
+			};
+
+			for (int n = 1; n <= max_squares; ++n) {
+				for (LevelHistogram& h : worker_histograms) h = LevelHistogram();
+
+				get_positions_with_n_tiles(n, [&] (const Position& p) {
+					positions.push_back(p);
+
+					if (positions.size() > POSITION_BATCH_SIZE) process_positions();
+				}, bound_width, bound_height, true /* only canonical positions */);
+
+				process_positions();
+
+				LevelHistogram level;
+				level.n = n;
+
+				for (const LevelHistogram& h : worker_histograms) level.merge(h);
+				levels.push_back(std::move(level));
+			}
+
+			return levels;
+		}
+
+		void write_csv(const std::vector<LevelHistogram>& levels, const char* filename) {
+			FILE* f = fopen(filename, "w");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open file");
+
+			std::fprintf(f, "n,histogram,value,count\n");
+
+			auto write_histogram = [&] (int n, const char* name, const std::vector<uint64_t>& histogram) {
+				for (size_t value = 0; value < histogram.size(); ++value) {
+					if (histogram[value])
+						std::fprintf(f, "%i,%s,%zu,%llu\n", n, name, value, (unsigned long long) histogram[value]);
+				}
+			};
+
+			for (const LevelHistogram& level : levels) {
+				write_histogram(level.n, "losing", { level.positions - level.losing, level.losing });
+				write_histogram(level.n, "dte", level.dte);
+				write_histogram(level.n, "winning_cuts", level.winning_cuts);
+				write_histogram(level.n, "height", level.height);
+				write_histogram(level.n, "width", level.width);
+			}
+
+			fclose(f);
+		}
+
+		void write_json(const std::vector<LevelHistogram>& levels, const char* filename) {
+			FILE* f = fopen(filename, "w");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open file");
+
+			auto write_histogram = [&] (const char* name, const std::vector<uint64_t>& histogram) {
+				std::fprintf(f, ", \"%s\": [", name);
+
+				for (size_t value = 0; value < histogram.size(); ++value)
+					std::fprintf(f, (value == 0) ? "%llu" : ", %llu", (unsigned long long) histogram[value]);
+
+				std::fprintf(f, "]");
+			};
+
+			std::fprintf(f, "[\n");
+
+			for (size_t i = 0; i < levels.size(); ++i) {
+				const LevelHistogram& level = levels[i];
+
+				std::fprintf(f, "  {\"n\": %i, \"positions\": %llu, \"losing\": %llu, \"losing_fraction\": %.9g", level.n,
+				             (unsigned long long) level.positions, (unsigned long long) level.losing, level.losing_fraction());
+				write_histogram("dte", level.dte);
+				write_histogram("winning_cuts", level.winning_cuts);
+				write_histogram("height", level.height);
+				write_histogram("width", level.width);
+				std::fprintf(f, (i + 1 < levels.size()) ? "},\n" : "}\n");
+			}
+
+			std::fprintf(f, "]\n");
+			fclose(f);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef CHOMP_ANALYTICS_H
+#define CHOMP_ANALYTICS_H
+
+#include <position.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace Chomp {
+	namespace analytics {
+		// Distributions over all positions (in both orientations) with n squares
+		struct LevelHistogram {
+			int n = 0;
+			uint64_t positions = 0;
+			uint64_t losing = 0;
+
+			// Number of positions with each value, indexed by the value
+			std::vector<uint64_t> dte;
+			std::vector<uint64_t> winning_cuts;
+			std::vector<uint64_t> height;
+			std::vector<uint64_t> width;
+
+			double losing_fraction() const { return positions ? (double) losing / positions : 0; }
+
+			void add(const Position& p, int multiplicity);
+			void merge(const LevelHistogram& other);
+		};
+
+		/**
+		 * Gather per-level histograms over a solved table, one level at a time, with each worker accumulating into its own
+		 * histogram. The table must have been built with compute_dte, and should have been with compute_winning_moves, without
+		 * which every winning position falls back to scanning its cuts. Throws if the region isn't within answered_region
+		 * @param max_squares Last level to analyze
+		 * @param bound_width -1 if unbounded; otherwise, the bound on the width, as passed to hash_positions
+		 * @param bound_height -1 if unbounded; otherwise, the bound on the height, as passed to hash_positions
+		 */
+		std::vector<LevelHistogram> analyze(int max_squares, int bound_width=-1, int bound_height=-1);
+
+		// One row per histogram bin: n,histogram,value,count. The "losing" histogram has value 1 for losing positions
+		void write_csv(const std::vector<LevelHistogram>& levels, const char* filename);
+		void write_json(const std::vector<LevelHistogram>& levels, const char* filename);
+	}
+}
+
+#endif //CHOMP_ANALYTICS_H
@@ -0,0 +1,69 @@
+#include <batch.hpp>
+#include <stdexcept>
+
+namespace Chomp {
+	int PositionView::square_count() const {
+		int sum = 0;
+		for (int i = 0; i < height; ++i)
+			sum += rows[i];
+		return sum;
+	}
+
+	Position PositionView::to_position() const {
+		Position p;
+
+		std::copy(rows, rows + height, p.rows);
+		p.height = height;
+		p.o = o;
+
+		return p;
+	}
+
+	Position PositionView::cut(int row, int col) const {
+		Position p;
+
+		for (int i = 0; i < row; ++i) {
+			p.rows[i] = rows[i];
+		}
+
+		if (col == 0) {
+			p.height = row;
+		} else {
+			for (int i = row; i < height; ++i) {
+				p.rows[i] = std::min(col, (int)rows[i]);
+			}
+
+			p.height = height;
+		}
+
+		return p;
+	}
+
+	Position PositionView::cut(Cut c) const {
+		return cut(c.first, c.second);
+	}
+
+	void PositionBatch::push_back(const Position& p) {
+		if (p.height > 0 && p.rows[0] > UINT16_MAX)
+			throw std::runtime_error(FILE_LINE"Position too wide for a PositionBatch");
+		if (arena.size() + p.height > UINT32_MAX)
+			throw std::runtime_error(FILE_LINE"PositionBatch arena is full");
+
+		index.push_back({ (uint32_t)arena.size(), (uint8_t)p.height, p.o });
+		arena.insert(arena.end(), p.rows, p.rows + p.height);
+	}
+
+	void PositionBatch::clear() {
+		arena.clear();
+		index.clear();
+	}
+
+	void PositionBatch::reserve(size_t positions, size_t rows) {
+		index.reserve(positions);
+		arena.reserve(rows);
+	}
+
+	size_t PositionBatch::memory_usage() const {
+		return arena.capacity() * sizeof(narrow_row) + index.capacity() * sizeof(Entry);
+	}
+}
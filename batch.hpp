@@ -0,0 +1,81 @@
+#ifndef CHOMP_BATCH_H
+#define CHOMP_BATCH_H
+
+#include <position.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace Chomp {
+	// Row count as stored in a PositionBatch
+	using narrow_row = uint16_t;
+
+	/**
+	 * Non-owning view of a position stored in a PositionBatch, valid until the batch is next modified
+	 */
+	struct PositionView {
+		const narrow_row* rows;
+		int height;
+		Orientation o;
+
+		int operator[](int i) const { return rows[i]; }
+
+		int get_width() const { return (height > 0) ? rows[0] : 0; }
+		int square_count() const;
+
+		// Widen into a full Position
+		Position to_position() const;
+		Position cut(int row, int col) const;
+		Position cut(Cut c) const;
+	};
+
+	/**
+	 * Positions stored back to back as runs of narrow row counts in a single arena, with each one's offset, height and
+	 * orientation in a side index. A position takes 2 * height + 8 bytes rather than sizeof(Position), and clear() keeps
+	 * the capacity for the next batch.
+	 */
+	class PositionBatch {
+	private:
+		struct Entry {
+			uint32_t offset;
+			uint8_t height;
+			Orientation o;
+		};
+
+		std::vector<narrow_row> arena;
+		std::vector<Entry> index;
+	public:
+		class iterator {
+		private:
+			const PositionBatch* batch;
+			size_t i;
+		public:
+			iterator(const PositionBatch* batch, size_t i) : batch(batch), i(i) {}
+
+			PositionView operator*() const { return (*batch)[i]; }
+			iterator& operator++() { ++i; return *this; }
+			iterator operator+(ptrdiff_t d) const { return { batch, i + d }; }
+			ptrdiff_t operator-(const iterator& it) const { return (ptrdiff_t)i - (ptrdiff_t)it.i; }
+			bool operator==(const iterator& it) const { return i == it.i; }
+			bool operator!=(const iterator& it) const { return i != it.i; }
+		};
+
+		void push_back(const Position& p);
+		void clear();
+		void reserve(size_t positions, size_t rows);
+
+		size_t size() const { return index.size(); }
+		bool empty() const { return index.empty(); }
+		// Bytes held by the arena and index, including spare capacity
+		size_t memory_usage() const;
+
+		PositionView operator[](size_t i) const {
+			const Entry& e = index[i];
+			return { arena.data() + e.offset, e.height, e.o };
+		}
+
+		iterator begin() const { return { this, 0 }; }
+		iterator end() const { return { this, size() }; }
+	};
+}
+
+#endif //CHOMP_BATCH_H
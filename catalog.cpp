@@ -0,0 +1,298 @@
+#include <catalog.hpp>
+#include <tablefile.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Chomp {
+	namespace catalog {
+		static const size_t WRITE_BUFFER_SIZE = 1 << 22;
+
+		const uint8_t* decode(const uint8_t* in, const uint8_t* end, int n, Position& p) {
+			// Rows from the top down, as the path meets them
+			int top_down[MAX_HEIGHT];
+			int height = 0, width = 0, placed = 0;
+
+			for (; placed < n; ++in) {
+				if (in == end) return nullptr;
+
+				unsigned byte = *in;
+				int used = 0;
+
+				// Each set bit ends a row, after the zeros that widened it
+				while (placed < n) {
+					unsigned rest = byte >> used;
+					if (!rest) {
+						width += 8 - used;
+						break;
+					}
+
+					int zeros = __builtin_ctz(rest);
+					width += zeros;
+					used += zeros + 1;
+
+					if (height == MAX_HEIGHT || width == 0) return nullptr;
+
+					top_down[height++] = width;
+					placed += width;
+				}
+			}
+
+			if (placed != n) return nullptr;
+
+			p.make_empty();
+			p.height = height;
+			p.o = Orientation::UNKNOWN;
+
+			for (int i = 0; i < height; ++i) p.rows[i] = top_down[height - 1 - i];
+
+			return in;
+		}
+
+		bool Filter::matches(const Position& p) const {
+			int n = p.square_count(), width = p.get_width(), height = p.get_height();
+
+			return n >= min_squares && n <= max_squares && width >= min_width && width <= max_width
+				&& height >= min_height && height <= max_height;
+		}
+
+		Writer::Writer(const char* filename, int max_squares, int bound_width, int bound_height, bool has_dte)
+			: filename(filename), temporary(std::string(filename) + ".tmp"), buffer(WRITE_BUFFER_SIZE) {
+			f = fopen(temporary.c_str(), "wb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open catalog file");
+
+			std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+			Header header = {};
+			memcpy(header.magic, HEADER_MAGIC, sizeof(header.magic));
+			header.version = VERSION;
+			header.flags = has_dte ? FLAG_DTE : 0;
+			header.max_squares = max_squares;
+			header.bound_width = bound_width;
+			header.bound_height = bound_height;
+			header.checksum = tablefile::checksum(&header, offsetof(Header, checksum));
+
+			write(&header, sizeof(header));
+		}
+
+		Writer::~Writer() {
+			if (f) {
+				fclose(f);
+				std::remove(temporary.c_str());
+			}
+		}
+
+		void Writer::write(const void* data, size_t size) {
+			if (fwrite(data, 1, size, f) != size) throw std::runtime_error(FILE_LINE"Failed to write catalog file");
+			offset += size;
+		}
+
+		void Writer::align() {
+			static const char zeros[64] = {};
+			if (offset % 64) write(zeros, 64 - offset % 64);
+		}
+
+		void Writer::add_level(int n, const std::vector<uint8_t>& codes, const std::vector<uint16_t>& dtes) {
+			if (!index.empty() && index.back().n >= n)
+				throw std::runtime_error(FILE_LINE"Levels must be added in increasing order");
+
+			LevelIndex level = {};
+			level.n = n;
+			level.count = dtes.size();
+			level.chunks = (dtes.size() + CHUNK_ENTRIES - 1) / CHUNK_ENTRIES;
+
+			// Walk the codes to find where each chunk starts, which also checks that there is one code per dte
+			std::vector<uint64_t> chunk_offsets(level.chunks);
+			const uint8_t* in = codes.data();
+			const uint8_t* end = codes.data() + codes.size();
+			Position p;
+
+			for (uint64_t i = 0; i < level.count; ++i) {
+				if (i % CHUNK_ENTRIES == 0) chunk_offsets[i / CHUNK_ENTRIES] = in - codes.data();
+
+				in = decode(in, end, n, p);
+				if (!in) throw std::runtime_error(FILE_LINE"Invalid position codes");
+			}
+
+			if (in != end) throw std::runtime_error(FILE_LINE"Position codes don't match the dtes");
+
+			align();
+			uint64_t hash = 0;
+
+			auto write_column = [&] (const void* data, size_t size, uint64_t& column_offset) {
+				column_offset = offset;
+				write(data, size);
+				hash = datastructs::XXH::XXH64(hash, tablefile::checksum(data, size));
+			};
+
+			write_column(codes.data(), codes.size(), level.codes_offset);
+			level.codes_size = codes.size();
+
+			// Keep the other columns aligned for the mapped reader
+			align();
+			write_column(chunk_offsets.data(), chunk_offsets.size() * sizeof(uint64_t), level.chunks_offset);
+			write_column(dtes.data(), dtes.size() * sizeof(uint16_t), level.dtes_offset);
+
+			level.checksum = hash;
+
+			index.push_back(level);
+		}
+
+		void Writer::finish() {
+			align();
+
+			Footer footer = {};
+			footer.index_offset = offset;
+			footer.levels = index.size();
+			footer.index_checksum = tablefile::checksum(index.data(), index.size() * sizeof(LevelIndex));
+			memcpy(footer.magic, FOOTER_MAGIC, sizeof(footer.magic));
+
+			write(index.data(), index.size() * sizeof(LevelIndex));
+			write(&footer, sizeof(footer));
+
+			bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+			ok = (fclose(f) == 0) && ok;
+			f = nullptr;
+
+			if (!ok || std::rename(temporary.c_str(), filename.c_str()) != 0)
+				throw std::runtime_error(FILE_LINE"Failed to write catalog file");
+		}
+
+		Catalog::Catalog(const char* filename) {
+			int fd = open(filename, O_RDONLY);
+			if (fd < 0) throw std::runtime_error(FILE_LINE"Failed to open catalog file");
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header) + sizeof(Footer)) {
+				close(fd);
+				throw std::runtime_error(FILE_LINE"Not a catalog file");
+			}
+
+			size = st.st_size;
+			void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+
+			if (mapped == MAP_FAILED) throw std::runtime_error(FILE_LINE"Failed to map catalog file");
+			data = (const uint8_t*) mapped;
+
+			header = (const Header*) data;
+			const Footer* footer = (const Footer*) (data + size - sizeof(Footer));
+
+			if (memcmp(header->magic, HEADER_MAGIC, sizeof(HEADER_MAGIC)) || header->version != VERSION
+			    || header->checksum != tablefile::checksum(header, offsetof(Header, checksum))
+			    || memcmp(footer->magic, FOOTER_MAGIC, sizeof(FOOTER_MAGIC))
+			    || footer->index_offset + footer->levels * sizeof(LevelIndex) + sizeof(Footer) != size) {
+				munmap(mapped, size);
+				throw std::runtime_error(FILE_LINE"Not a catalog file, or truncated");
+			}
+
+			const LevelIndex* index = (const LevelIndex*) (data + footer->index_offset);
+			if (footer->index_checksum != tablefile::checksum(index, footer->levels * sizeof(LevelIndex))) {
+				munmap(mapped, size);
+				throw std::runtime_error(FILE_LINE"Corrupt catalog index");
+			}
+
+			for (uint64_t i = 0; i < footer->levels; ++i) {
+				int n = index[i].n;
+				if (n < 0) continue;
+				if ((int) levels.size() <= n) levels.resize(n + 1, LevelIndex {});
+
+				levels[n] = index[i];
+			}
+		}
+
+		Catalog::~Catalog() {
+			if (data) munmap((void*) data, size);
+		}
+
+		bool Catalog::verify() const {
+			for (const LevelIndex& level : levels) {
+				if (level.count == 0) continue;
+
+				uint64_t hash = 0;
+				hash = datastructs::XXH::XXH64(hash, tablefile::checksum(data + level.codes_offset, level.codes_size));
+				hash = datastructs::XXH::XXH64(hash, tablefile::checksum(data + level.chunks_offset, level.chunks * sizeof(uint64_t)));
+				hash = datastructs::XXH::XXH64(hash, tablefile::checksum(data + level.dtes_offset, level.count * sizeof(uint16_t)));
+
+				if (hash != level.checksum) return false;
+			}
+
+			return true;
+		}
+
+		std::vector<Catalog::Chunk> Catalog::chunks(const Filter& filter) const {
+			std::vector<Chunk> ret;
+
+			for (int n = std::max(filter.min_squares, 0); n <= std::min(filter.max_squares, max_level()); ++n) {
+				for (uint32_t i = 0; i < levels[n].chunks; ++i)
+					ret.push_back({ n, i });
+			}
+
+			return ret;
+		}
+
+		void Catalog::export_text(const Filter& filter, const char* filename) const {
+			// Chunks formatted per round, before any is written
+			const size_t ROUND_CHUNKS = 4 * NUM_THREADS;
+
+			FILE* f = fopen(filename, "w");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open export file");
+
+			std::vector<Chunk> work = chunks(filter);
+			std::vector<std::string> formatted(ROUND_CHUNKS);
+			datastructs::WorkerPool pool(NUM_THREADS);
+
+			for (size_t round = 0; round < work.size(); round += ROUND_CHUNKS) {
+				size_t round_size = std::min(ROUND_CHUNKS, work.size() - round);
+				std::atomic<size_t> next { 0 };
+				std::exception_ptr error;
+				std::mutex error_mutex;
+
+				auto format = [&] (int) {
+					char line[16 * (MAX_HEIGHT + 2)];
+
+					try {
+						for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < round_size; ) {
+							std::string& out = formatted[i];
+							out.clear();
+
+							auto add = [&] (const Position& p, int dte) {
+								int length = std::snprintf(line, sizeof(line), "%i %i", p.square_count(), dte);
+								for (int row = 0; row < p.height; ++row)
+									length += std::snprintf(line + length, sizeof(line) - length, " %i", p.rows[row]);
+
+								out.append(line, length);
+								out.push_back('\n');
+							};
+
+							scan_chunk(work[round + i], filter, add);
+						}
+					} catch (...) {
+						std::lock_guard<std::mutex> lock(error_mutex);
+						if (!error) error = std::current_exception();
+						next = round_size;
+					}
+				};
+
+				pool.run(format);
+
+				if (error) {
+					fclose(f);
+					std::rethrow_exception(error);
+				}
+
+				for (size_t i = 0; i < round_size; ++i) {
+					if (fwrite(formatted[i].data(), 1, formatted[i].size(), f) != formatted[i].size()) {
+						fclose(f);
+						throw std::runtime_error(FILE_LINE"Failed to write export file");
+					}
+				}
+			}
+
+			if (fclose(f) != 0) throw std::runtime_error(FILE_LINE"Failed to write export file");
+		}
+	}
+}
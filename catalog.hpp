@@ -0,0 +1,249 @@
+#ifndef CHOMP_CATALOG_H
+#define CHOMP_CATALOG_H
+
+#include <position.hpp>
+#include <datastructs.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Chomp {
+	namespace catalog {
+		/*
+		 * Catalog of losing positions, little endian. Unlike a table, which only has hashes, it can list its positions:
+		 *
+		 *   Header (64 bytes)
+		 *   Level sections, each 64-byte aligned:
+		 *     codes of the level's positions, back to back (see encode)
+		 *     byte offset of every CHUNK_ENTRIES-th code (uint64_t[chunks]), so chunks can be decoded independently
+		 *     dte of each position, in the same order (uint16_t[count]), NO_DTE if not computed
+		 *   Level index (LevelIndex[levels])
+		 *   Footer (32 bytes)
+		 *
+		 * Positions are stored in their canonical orientation, in no particular order within a level.
+		 */
+		constexpr char HEADER_MAGIC[8] = { 'C', 'H', 'O', 'M', 'P', 'C', 'A', 'T' };
+		constexpr char FOOTER_MAGIC[8] = { 'C', 'H', 'O', 'M', 'P', 'E', 'N', 'D' };
+		constexpr uint32_t VERSION = 1;
+		constexpr uint64_t CHUNK_ENTRIES = 4096;
+
+		constexpr uint32_t FLAG_DTE = 1;
+		constexpr uint16_t NO_DTE = UINT16_MAX;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t flags;
+			int32_t max_squares;
+			int32_t bound_width;
+			int32_t bound_height;
+			uint32_t reserved0;
+			uint64_t reserved[3];
+			// Of the bytes above
+			uint64_t checksum;
+		};
+
+		struct LevelIndex {
+			int32_t n;
+			uint32_t chunks;
+			uint64_t count;
+			uint64_t codes_offset;
+			uint64_t codes_size;
+			uint64_t chunks_offset;
+			uint64_t dtes_offset;
+			// Of the whole section
+			uint64_t checksum;
+			uint64_t reserved;
+		};
+
+		struct Footer {
+			uint64_t index_offset;
+			uint64_t levels;
+			// Of the level index
+			uint64_t index_checksum;
+			char magic[8];
+		};
+
+		static_assert(sizeof(Header) == 64 && sizeof(LevelIndex) == 64 && sizeof(Footer) == 32);
+
+		/**
+		 * Append the code of a position: its boundary as a lattice path from the top left corner, one bit per step (least
+		 * significant first), 0 for a step right and 1 for a step down past a row. Each row is thus preceded by as many zeros
+		 * as it is wider than the row above it. The code takes width + height bits, rounded up to whole bytes; it doesn't
+		 * record its own length, since a path ends once its rows add up to the level's n
+		 * @tparam P Position or PositionView
+		 */
+		template <typename P>
+		void encode(const P& p, std::vector<uint8_t>& out) {
+			size_t bit = out.size() * 8;
+			out.resize(out.size() + (p.rows[0] + p.height + 7) / 8, 0);
+
+			int width = 0;
+			for (int i = p.height - 1; i >= 0; --i) {
+				bit += p.rows[i] - width;
+				width = p.rows[i];
+
+				out[bit / 8] |= (uint8_t) (1 << (bit % 8));
+				bit++;
+			}
+		}
+
+		/**
+		 * Decode the code of a position with n squares into p
+		 * @return Pointer past the code, or nullptr if it isn't a valid code
+		 */
+		const uint8_t* decode(const uint8_t* in, const uint8_t* end, int n, Position& p);
+
+		// Which positions a scan visits. Bounds are inclusive
+		struct Filter {
+			int min_squares = 0, max_squares = INT_MAX;
+			int min_width = 0, max_width = INT_MAX;
+			int min_height = 0, max_height = INT_MAX;
+			// Also visit the reflection of each asymmetric position, which has the same dte
+			bool reflections = false;
+
+			bool matches(const Position& p) const;
+		};
+
+		/**
+		 * Writes a catalog one level at a time, in increasing order of n
+		 */
+		class Writer {
+		private:
+			FILE* f;
+			std::string filename, temporary;
+			uint64_t offset = 0;
+			std::vector<LevelIndex> index;
+			std::vector<char> buffer;
+
+			void write(const void* data, size_t size);
+			void align();
+		public:
+			Writer(const char* filename, int max_squares, int bound_width, int bound_height, bool has_dte);
+			// Abandons the file if finish() wasn't called
+			~Writer();
+
+			// @param codes Codes of the losing positions with n squares; dtes has one entry per code
+			void add_level(int n, const std::vector<uint8_t>& codes, const std::vector<uint16_t>& dtes);
+			// Write the index and footer, then move the file into place
+			void finish();
+		};
+
+		/**
+		 * Read-only view of a catalog, mapped rather than loaded
+		 */
+		class Catalog {
+		private:
+			const uint8_t* data = nullptr;
+			size_t size = 0;
+			const Header* header = nullptr;
+			// Indexed by n; levels not in the file have count 0
+			std::vector<LevelIndex> levels;
+
+			struct Chunk {
+				int n;
+				uint32_t index;
+			};
+
+			std::vector<Chunk> chunks(const Filter& filter) const;
+
+			// Call f(p, dte) for each position of the chunk that passes the filter
+			template <typename F>
+			void scan_chunk(const Chunk& chunk, const Filter& filter, F& f) const;
+		public:
+			static const int NUM_THREADS = 8;
+
+			// Checks the header, index and footer, but not the sections (see verify)
+			explicit Catalog(const char* filename);
+			~Catalog();
+
+			Catalog(const Catalog&) = delete;
+			Catalog& operator=(const Catalog&) = delete;
+
+			const Header& get_header() const { return *header; }
+			int max_level() const { return (int) levels.size() - 1; }
+			// Number of losing positions with n squares, in their canonical orientation
+			uint64_t count(int n) const { return (n >= 0 && n <= max_level()) ? levels[n].count : 0; }
+
+			// Check every section's checksum, reading the whole file
+			bool verify() const;
+
+			/**
+			 * Call f(worker, p, dte) for each position that passes the filter, from NUM_THREADS threads at once, each taking
+			 * a chunk at a time. dte is -1 if the catalog has none
+			 */
+			template <typename F>
+			void scan(const Filter& filter, F f) const;
+
+			/**
+			 * Write one line per position that passes the filter, "<squares> <dte> <rows, bottom to top>", in catalog order.
+			 * Chunks are formatted in parallel and written in order
+			 */
+			void export_text(const Filter& filter, const char* filename) const;
+		};
+
+		template <typename F>
+		void Catalog::scan_chunk(const Chunk& chunk, const Filter& filter, F& f) const {
+			const LevelIndex& level = levels[chunk.n];
+			const uint64_t* chunk_offsets = (const uint64_t*) (data + level.chunks_offset);
+			const uint16_t* dtes = (const uint16_t*) (data + level.dtes_offset);
+
+			const uint8_t* in = data + level.codes_offset + chunk_offsets[chunk.index];
+			const uint8_t* end = data + level.codes_offset + level.codes_size;
+
+			uint64_t first = (uint64_t) chunk.index * CHUNK_ENTRIES;
+			uint64_t last = std::min(first + CHUNK_ENTRIES, level.count);
+
+			Position p;
+			for (uint64_t i = first; i < last; ++i) {
+				in = decode(in, end, chunk.n, p);
+				if (!in) throw std::runtime_error(FILE_LINE"Corrupt catalog section");
+
+				int dte = (dtes[i] == NO_DTE) ? -1 : dtes[i];
+
+				if (filter.matches(p)) f(p, dte);
+
+				if (filter.reflections && p.is_canonical() != Orientation::SYMMETRICAL) {
+					Position reflection = p.flip();
+					if (filter.matches(reflection)) f(reflection, dte);
+				}
+			}
+		}
+
+		template <typename F>
+		void Catalog::scan(const Filter& filter, F f) const {
+			std::vector<Chunk> work = chunks(filter);
+			std::atomic<size_t> next { 0 };
+
+			// The first error of any worker, rethrown on the calling thread
+			std::exception_ptr error;
+			std::mutex error_mutex;
+
+			datastructs::WorkerPool pool(NUM_THREADS);
+
+			auto run = [&] (int worker) {
+				auto visit = [&] (const Position& p, int dte) { f(worker, p, dte); };
+
+				try {
+					for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < work.size(); )
+						scan_chunk(work[i], filter, visit);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error) error = std::current_exception();
+					// Stop the other workers early
+					next = work.size();
+				}
+			};
+
+			pool.run(run);
+			if (error) std::rethrow_exception(error);
+		}
+	}
+}
+
+#endif //CHOMP_CATALOG_H
@@ -6,24 +6,94 @@
 */
 
 #include <datastructs.hpp>
+#include <utility>
 
 namespace Chomp {
 	namespace datastructs {
 
+		const uint64_t* BloomFilter::block(uint64_t hash) const {
+			return words + (XXH::XXH64(0, hash) % num_blocks) * (bloom_block_bits / 64);
+		}
+
 		void BloomFilter::insert(uint64_t hash) {
-			for (int i = 0; i < num_hash_functions; ++i) {
-				bits.set(XXH::XXH64(i, hash) % bits.size());
+			uint64_t *b = const_cast<uint64_t*>(block(hash));
+			uint64_t bit_indices = XXH::XXH64(1, hash);
+
+			// 9 bits of bit_indices per hash function
+			for (unsigned int i = 0; i < num_hash_functions; ++i, bit_indices >>= 9) {
+				b[(bit_indices & 511) / 64] |= 1ULL << (bit_indices & 63);
 			}
 		}
 
 		bool BloomFilter::probably_contains(uint64_t hash) const {
-			for (int i = 0; i < num_hash_functions; ++i) {
-				if (!bits.test(XXH::XXH64(i, hash) % bits.size())) return false;
+			const uint64_t *b = block(hash);
+			uint64_t bit_indices = XXH::XXH64(1, hash);
+
+			for (unsigned int i = 0; i < num_hash_functions; ++i, bit_indices >>= 9) {
+				if (!(b[(bit_indices & 511) / 64] & (1ULL << (bit_indices & 63)))) return false;
 			}
 
 			return true;
 		}
 
+		void BloomFilter::prefetch(uint64_t hash) const {
+			__builtin_prefetch(block(hash));
+		}
+
+		WorkerPool::WorkerPool(int num_threads) {
+			for (int i = 0; i < num_threads; ++i) {
+				threads.emplace_back([this, i] { work(i); });
+			}
+		}
+
+		WorkerPool::~WorkerPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+
+			start.notify_all();
+			for (std::thread& thread : threads) thread.join();
+		}
+
+		void WorkerPool::work(int worker) {
+			uint64_t seen = 0;
+
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					start.wait(lock, [&] { return stopping || generation != seen; });
+
+					if (stopping) return;
+					seen = generation;
+				}
+
+				std::exception_ptr job_error;
+
+				try {
+					job(job_context, worker);
+				} catch (...) {
+					job_error = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (job_error && !error) error = job_error;
+				if (--remaining == 0) done.notify_one();
+			}
+		}
+
+		void WorkerPool::run_job() {
+			std::unique_lock<std::mutex> lock(mutex);
+
+			remaining = threads.size();
+			generation++;
+			start.notify_all();
+
+			done.wait(lock, [&] { return remaining == 0; });
+
+			if (error) std::rethrow_exception(std::exchange(error, nullptr));
+		}
+
 		namespace XXH {
 			uint64_t XXH64(uint64_t seed, uint64_t data) {
 
@@ -1,17 +1,144 @@
-#include <bitset>
+#ifndef CHOMP_DATASTRUCTS_H
+#define CHOMP_DATASTRUCTS_H
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 namespace Chomp {
 	namespace datastructs {
 		const unsigned long long max_bloom_size = 8589934592; // 1 Gigabyte
-		const unsigned int num_hash_functions = 18; // https://hur.st/bloomfilter/?n=339699273&p=&m=8589934592&k=18
+		// Blocked filter: each key sets its bits within one cache line, so a probe is a single (prefetchable) miss. With
+		// 512-bit blocks the false positive rate at n=339699273 is about 1e-4, versus 5e-6 for the unblocked k=18 filter
+		const unsigned int num_hash_functions = 7;
+		const unsigned long long bloom_block_bits = 512;
 
 		class BloomFilter {
 		private:
-			std::bitset<max_bloom_size> bits;
+			static constexpr unsigned long long num_blocks = max_bloom_size / bloom_block_bits;
+
+			alignas(64) uint64_t words[max_bloom_size / 64];
+
+			const uint64_t* block(uint64_t hash) const;
 		public:
 			void insert(uint64_t hash);
 
 			bool probably_contains(uint64_t hash) const;
+
+			// Start fetching the block for hash, ahead of a probably_contains call
+			void prefetch(uint64_t hash) const;
+
+			// Raw bits, for snapshots
+			static constexpr size_t size_words = max_bloom_size / 64;
+			uint64_t* data() { return words; }
+			const uint64_t* data() const { return words; }
+		};
+
+		/**
+		 * Fixed set of threads that live for the whole solve, so that dispatching a batch creates no threads and allocates
+		 * nothing
+		 */
+		class WorkerPool {
+		private:
+			std::vector<std::thread> threads;
+			std::mutex mutex;
+			std::condition_variable start, done;
+
+			// Type-erased job, so that run() needn't allocate a std::function
+			void (*job)(void* context, int worker) = nullptr;
+			void* job_context = nullptr;
+
+			uint64_t generation = 0;
+			int remaining = 0;
+			bool stopping = false;
+			// First exception the current job threw on any worker
+			std::exception_ptr error;
+
+			void work(int worker);
+			void run_job();
+		public:
+			explicit WorkerPool(int num_threads);
+			~WorkerPool();
+
+			int size() const { return threads.size(); }
+
+			// Call f(worker) for worker = 0, ..., size() - 1, each on its own thread, and wait for all of them. The first
+			// exception any of them throws is rethrown here once all have returned
+			template <typename F>
+			void run(F& f) {
+				job = [] (void* context, int worker) { (*static_cast<F*>(context))(worker); };
+				job_context = &f;
+				run_job();
+			}
+		};
+
+		/**
+		 * Bounded lock-free single-producer single-consumer queue. push() and pop() block (on the atomics themselves) while
+		 * the ring is full or empty respectively.
+		 * @tparam T Trivially copyable element type
+		 */
+		template <typename T>
+		class SpscRing {
+		private:
+			std::vector<T> slots;
+			size_t mask;
+
+			// Next slot to pop and next slot to push; they only ever increase
+			alignas(64) std::atomic<size_t> head{0};
+			alignas(64) std::atomic<size_t> tail{0};
+		public:
+			// Capacity is rounded up to a power of two
+			explicit SpscRing(size_t capacity) {
+				size_t rounded = 1;
+				while (rounded < capacity) rounded <<= 1;
+
+				slots.resize(rounded);
+				mask = rounded - 1;
+			}
+
+			bool try_push(T value) {
+				size_t t = tail.load(std::memory_order_relaxed);
+				if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+
+				slots[t & mask] = value;
+				tail.store(t + 1, std::memory_order_release);
+				tail.notify_one();
+
+				return true;
+			}
+
+			bool try_pop(T& value) {
+				size_t h = head.load(std::memory_order_relaxed);
+				if (h == tail.load(std::memory_order_acquire)) return false;
+
+				value = slots[h & mask];
+				head.store(h + 1, std::memory_order_release);
+				head.notify_one();
+
+				return true;
+			}
+
+			void push(T value) {
+				while (!try_push(value)) {
+					size_t h = head.load(std::memory_order_acquire);
+					if (tail.load(std::memory_order_relaxed) - h == slots.size()) head.wait(h);
+				}
+			}
+
+			T pop() {
+				T value;
+
+				while (!try_pop(value)) {
+					size_t t = tail.load(std::memory_order_acquire);
+					if (t == head.load(std::memory_order_relaxed)) tail.wait(t);
+				}
+
+				return value;
+			}
 		};
 
 		namespace XXH {
@@ -25,4 +152,6 @@ namespace Chomp {
 			uint64_t XXH64(uint64_t seed, uint64_t data);
 		}
 	}
-}
\ No newline at end of file
+}
+
+#endif //CHOMP_DATASTRUCTS_H
@@ -3,11 +3,146 @@
 //
 
 #include <position.hpp>
+#include <analytics.hpp>
+#include <service.hpp>
+#include <strategy.hpp>
+#include <tablefile.hpp>
 #include <iostream>
+#include <algorithm>
+#include <random>
 #include <chrono>
+#include <csignal>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+int main (int argc, char** argv) {
+	using namespace Chomp;
+
+	// A v2 table file is mapped and shared with other processes serving it, and read in up front; anything else is taken
+	// to be a snapshot
+	auto load = [] (const char* filename) {
+		if (tablefile::is_table_file(filename))
+			map_table(filename, { .populate=true });
+		else
+			load_snapshot(filename);
+	};
+
+	// chomp serve <snapshot or table file> [socket]: load the tables once, then answer queries (see service.hpp) on the
+	// socket, or on stdin/stdout without one
+	if (argc >= 3 && !strcmp(argv[1], "serve")) {
+		// A table file can be replaced (tablefile::Writer renames the finished file into place) and swapped in without a restart.
+		// A snapshot can't, so a SIGHUP meant for a table file mustn't kill the server either
+		if (tablefile::is_table_file(argv[2]))
+			service::reload_on_sighup(argv[2], { .populate=true });
+		else
+			std::signal(SIGHUP, SIG_IGN);
+		load(argv[2]);
+
+		service::Server server;
+		if (argc >= 4) {
+			server.serve_socket(argv[3]);
+		} else {
+			server.serve_stream(STDIN_FILENO, STDOUT_FILENO);
+			server.print_latency(stderr);
+		}
+
+		return 0;
+	}
+
+	// chomp bench <snapshot or table file> <max squares>: compare single and batched queries over every position up to
+	// max squares
+	if (argc >= 4 && !strcmp(argv[1], "bench")) {
+		load(argv[2]);
+
+		std::vector<Position> positions;
+		get_positions_with_tiles(1, atoi(argv[3]) + 1, [&] (const Position& p) { positions.push_back(p); });
+
+		// Queries don't arrive in enumeration order
+		std::shuffle(positions.begin(), positions.end(), std::mt19937_64(1));
+		service::benchmark(positions, stdout);
+
+		return 0;
+	}
+
+	// chomp analytics <max squares> <bound width> <bound height> <csv file>: solve with dtes and winning move counts, then
+	// write per-level histograms (see analytics.hpp). A bound of -1 is unbounded
+	if (argc >= 6 && !strcmp(argv[1], "analytics")) {
+		int max_squares = atoi(argv[2]), bound_width = atoi(argv[3]), bound_height = atoi(argv[4]);
+
+		hash_positions(max_squares, bound_width, bound_height, { .compute_dte=true, .compute_winning_moves=true });
+		analytics::write_csv(analytics::analyze(max_squares, bound_width, bound_height), argv[5]);
+
+		return 0;
+	}
+
+	// chomp solve <max squares> <bound width> <bound height> <table file> [snapshot]: solve with everything play and
+	// selfplay use, writing a table file for serve and the others, and a snapshot of the tables if asked. A bound of -1
+	// is unbounded
+	if (argc >= 6 && !strcmp(argv[1], "solve")) {
+		int max_squares = atoi(argv[2]), bound_width = atoi(argv[3]), bound_height = atoi(argv[4]);
+
+		hash_positions(max_squares, bound_width, bound_height, { .compute_dte=true, .compute_winning_moves=true,
+		                                                         .compute_best_moves=true, .table_file=argv[5] });
+		if (argc >= 7) store_snapshot(argv[6]);
+
+		return 0;
+	}
+
+	// A position given as its rows from the bottom up, separated by commas, like 5,5,3
+	auto parse_position = [] (const char* s) {
+		Position p = Position::empty_position();
+
+		for (char* end; *s; s = (*end == ',') ? end + 1 : end) {
+			if (p.height == MAX_HEIGHT) throw std::runtime_error(FILE_LINE"Position too tall");
+
+			p.rows[p.height++] = (int) strtol(s, &end, 10);
+			if (end == s) throw std::runtime_error(FILE_LINE"Expected a row length");
+		}
+
+		if (!p.is_legal() || (p.height > 0 && p.rows[p.height - 1] == 0))
+			throw std::runtime_error(FILE_LINE"Rows must be positive and non-increasing");
+
+		return p;
+	};
+
+	// chomp play <snapshot or table file> <position>: play the position out, the winner taking the quickest win and the
+	// loser holding off the loss longest
+	if (argc >= 4 && !strcmp(argv[1], "play")) {
+		load(argv[2]);
+		strategy::play_game(parse_position(argv[3]), strategy::Policy::LONGEST_DELAY, stdout);
+
+		return 0;
+	}
+
+	// chomp selfplay <snapshot or table file> <longest|trickiest|random> <games> <mistake rate> <position>...: play that
+	// many games from each position, both players following the policy but for mistakes, and print the game lengths
+	if (argc >= 7 && !strcmp(argv[1], "selfplay")) {
+		load(argv[2]);
+
+		strategy::SelfPlayOptions options;
+		if (!strcmp(argv[3], "trickiest")) options.first = strategy::Policy::TRICKIEST_RATIO;
+		else if (!strcmp(argv[3], "random")) options.first = strategy::Policy::RANDOM;
+		else if (strcmp(argv[3], "longest")) throw std::runtime_error(FILE_LINE"Unknown policy");
+
+		options.second = options.first;
+		options.games = strtoull(argv[4], nullptr, 10);
+		options.mistake_rate = atof(argv[5]);
+
+		std::vector<Position> starts;
+		for (int i = 6; i < argc; ++i) starts.push_back(parse_position(argv[i]));
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::vector<strategy::GameLengths> results = strategy::self_play(starts, options);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		strategy::print_lengths(results, stdout);
+		std::printf("%.0f games/s\n", starts.size() * options.games / seconds);
+
+		return 0;
+	}
 
-int main () {
 	// MAX_HEIGHT: 100, dimension: 80, NUM_THREADS: 8, BATCH_SIZE: 1000000
 	// With canonical hashing: hash_positions took 90.02 seconds (Tim's computer)
 	// With simple hashing: hash_positions took 200.3 seconds (Tim's computer)
@@ -17,7 +152,6 @@ int main () {
 	// With phmap::parallel_flat_hash_map: 53.1 seconds
 
 	constexpr int dimension = 80;
-	using namespace Chomp;
 
 	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
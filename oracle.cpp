@@ -0,0 +1,50 @@
+#include <oracle.hpp>
+
+namespace Chomp {
+	namespace oracle {
+		Stats stats;
+
+		// Two-row position (a, b), a >= b. The only losing children of a two-row position are (c + 1, c), and there is
+		// exactly one of them for a winning position, which gives the dte values by induction on b.
+		static Answer two_row(int a, int b, Family family) {
+			if (a == 0) return { family, true, 0, 0 }; // empty
+
+			if (a == b + 1) return { family, false, 2 * b + 1, 0 };
+			return { family, true, (a > b + 1) ? (2 * b + 2) : (2 * b), 1 };
+		}
+
+		// Hook with arms (j, k). Its children are hooks (or empty), and the only losing ones are balanced hooks.
+		static Answer hook(int j, int k) {
+			if (j == k) return { Family::HOOK, false, 2 * k + 1, 0 };
+			return { Family::HOOK, true, 2 * std::min(j, k) + 2, 1 };
+		}
+
+		template <typename P>
+		static Answer query_rows(const P& p) {
+			int height = p.height;
+			if (height <= 2) return two_row((height > 0) ? p.rows[0] : 0, (height == 2) ? p.rows[1] : 0, Family::TWO_ROW);
+
+			int width = p.rows[0];
+			if (width <= 2) {
+				// Rows are 2, ..., 2, 1, ..., 1, so the columns are (height, number of 2s)
+				int twos = 0;
+				while (twos < height && p.rows[twos] == 2) twos++;
+
+				return two_row(height, twos, Family::TWO_COLUMN);
+			}
+
+			if (p.rows[1] == 1) return hook(width - 1, height - 1);
+			if (p.rows[height - 1] == width) return { Family::RECTANGLE, true, -1, -1 };
+
+			return {};
+		}
+
+		Answer query(const Position& p) {
+			return query_rows(p);
+		}
+
+		Answer query(const PositionView& p) {
+			return query_rows(p);
+		}
+	}
+}
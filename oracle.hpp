@@ -0,0 +1,48 @@
+#ifndef CHOMP_ORACLE_H
+#define CHOMP_ORACLE_H
+
+#include <position.hpp>
+#include <batch.hpp>
+#include <atomic>
+
+namespace Chomp {
+	namespace oracle {
+		// Shape families whose outcome is known in closed form, so they never need to be probed or stored
+		enum class Family
+		{
+			NONE,
+			TWO_ROW, // (a, b) with at most two rows, losing iff a = b + 1. The empty position is (0, 0)
+			TWO_COLUMN, // conjugate of a two-row position
+			HOOK, // L shape with arms (rows[0] - 1, height - 1), losing iff the arms are balanced
+			RECTANGLE // full rectangle other than 1x1, always winning by strategy stealing
+		};
+
+		struct Answer {
+			Family family = Family::NONE;
+			bool is_winning = false;
+			// -1 if not known in closed form (rectangles)
+			int dte = -1;
+			int winning_cuts = -1;
+
+			bool known() const { return family != Family::NONE; }
+		};
+
+		/**
+		 * Answer a position in O(1) (O(height) for two-column positions) without touching the table
+		 * @param p Position, in either orientation
+		 * @return Answer with family NONE if p is not in one of the solved families
+		 */
+		Answer query(const Position& p);
+		Answer query(const PositionView& p);
+
+		// How much table work the oracle has saved, accumulated by hash_positions
+		struct Stats {
+			std::atomic<uint64_t> probes_eliminated{0};
+			std::atomic<uint64_t> stores_eliminated{0};
+		};
+
+		extern Stats stats;
+	}
+}
+
+#endif //CHOMP_ORACLE_H
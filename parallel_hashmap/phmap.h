@@ -1593,7 +1593,9 @@ public:
         }
         // bitor is a faster way of doing `max` here. We will round up to the next
         // power-of-2-minus-1, so bitor is good enough.
-        auto m = NormalizeCapacity((std::max)(n, size()));
+        // Leave room to grow, or rehash(0) on a table whose size is 2^k - 1 fills it with no empty slot, and every
+        // unsuccessful find probes forever (fixed the same way upstream)
+        auto m = NormalizeCapacity((std::max)(n, GrowthToLowerboundCapacity(size())));
         // n == 0 unconditionally rehashes as per the standard.
         if (n == 0 || m > capacity_) {
             resize(m);
@@ -3117,6 +3119,24 @@ public:
         }
     }
 
+    // Extension API: access one submap, e.g. to work on the submaps from separate threads
+    // (backported from upstream parallel-hashmap)
+    template <class F>
+    void with_submap(size_t idx, F&& fCallback) const {
+        const Inner& inner = sets_[idx];
+        const auto&  set   = inner.set_;
+        typename Lockable::SharedLock m(const_cast<Inner&>(inner));
+        fCallback(set);
+    }
+
+    template <class F>
+    void with_submap_m(size_t idx, F&& fCallback) {
+        Inner& inner = sets_[idx];
+        auto&  set   = inner.set_;
+        typename Lockable::UniqueLock m(inner);
+        fCallback(set);
+    }
+
     // Extension API: support for heterogeneous keys.
     //
     //   std::unordered_set<std::string> s;
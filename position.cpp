@@ -1,10 +1,20 @@
 #include <position.hpp>
 #include <store.hpp>
 #include <datastructs.hpp>
+#include <oracle.hpp>
+#include <simd.hpp>
+#include <batch.hpp>
+#include <alloc_counter.hpp>
+#include <stats.hpp>
+#include <tablefile.hpp>
+#include <spill.hpp>
+#include <catalog.hpp>
 #include <unordered_map>
 #include <thread>
 #include <memory>
 #include <atomic>
+#include <chrono>
+#include <algorithm>
 
 #undef INT_MAX
 #define INT_MAX 2147483647
@@ -47,27 +57,14 @@ namespace Chomp {
 
 		if (canonical == Orientation::CANONICAL || canonical == Orientation::SYMMETRICAL) return;
 		// Time to flip
-		flip();
+		flip_in_place();
 	}
 
 	void Position::flip_in_place() {
 		// Flip the position across the diagonal. Note that if rows[0] >= MAX_HEIGHT it may be chopped off
-		int col = 0;
 		int new_rows[MAX_HEIGHT];
 
-		for (int i = height - 1; i >= 0; --i) {
-			int row = rows[i];
-
-			while (row > col) {
-				new_rows[col] = i + 1;
-				col++;
-
-				if (col == MAX_HEIGHT) goto done;
-			}
-		}
-		done:
-
-		height = col;
+		height = simd::active->conjugate(rows, height, new_rows);
 		std::copy(new_rows, new_rows+height, rows);
 
 		using O = Orientation;
@@ -86,30 +83,7 @@ namespace Chomp {
 	}
 
 	Orientation Position::_is_canonical() const {
-		using O = Orientation;
-
-		// Easy criteria
-		if (rows[0] > height) return O::CANONICAL;
-		if (height == 0) return O::SYMMETRICAL;
-		if (rows[0] < height) return O::NOT_CANONICAL;
-
-		// We calculate the number of tiles in each column and compare sequentially to rows[col]
-		int col = 1, min_height = 0;
-		for (int i = height - 1; i >= min_height; --i) {
-			int r = rows[i];
-			while (r > col) {
-				// i is the number of tiles in column col
-				// compare col and row_compare
-				if (i + 1 > rows[col])
-					return O::NOT_CANONICAL;
-				else if (i + 1 < rows[col])
-					return O::CANONICAL;
-
-				col++;
-			}
-		}
-
-		return O::SYMMETRICAL; // symmetrical
+		return simd::active->orientation(rows, height);
 	}
 
 	Position Position::canonical() const {
@@ -121,20 +95,7 @@ namespace Chomp {
 
 	Position Position::cut(int row, int col) const {
 		Position p;
-
-		for (int i = 0; i < row; ++i) {
-			p.rows[i] = rows[i];
-		}
-
-		if (col == 0) {
-			p.height = row;
-		} else {
-			for (int i = row; i < height; ++i) {
-				p.rows[i] = std::min(col, rows[i]);
-			}
-
-			p.height = height;
-		}
+		p.height = simd::active->cut(rows, height, row, col, p.rows);
 
 		return p;
 	}
@@ -145,179 +106,913 @@ namespace Chomp {
 
 	map_type losing_position_info;
 	Chomp::datastructs::BloomFilter bloom_losing_position_info;
+	winning_map_type winning_position_info;
+	// What the tables above hold, as of the last completed solve or loaded snapshot
+	SolvedRegion solved_region;
+
+	// Levels moved out of the tables to stay within HashPositionOptions::table_memory_budget, one run per level, indexed by
+	// n. Empty until something is spilled
+	std::vector<spill::Run<LosingPositionInfo>> spilled_losing_position_info;
+	std::vector<spill::Run<WinningPositionInfo>> spilled_winning_position_info;
+
+	// The spilled run of level n, if any
+	template <typename Info>
+	static const Info* find_spilled(const std::vector<spill::Run<Info>>& runs, uint64_t canonical_hash, int n) {
+		return (n >= 0 && (size_t) n < runs.size()) ? runs[n].find(canonical_hash) : nullptr;
+	}
+
+	// Look up a canonical hash with n squares in the losing table, then in its spilled level
+	static const LosingPositionInfo* find_losing_unfiltered(uint64_t canonical_hash, int n) {
+		auto losing_position = losing_position_info.find(canonical_hash);
+		if (losing_position != losing_position_info.end()) return &losing_position->second;
+
+		return find_spilled(spilled_losing_position_info, canonical_hash, n);
+	}
+
+	// Probe the bloom filter, then the table, for a canonical hash
+	static const LosingPositionInfo* find_losing(uint64_t canonical_hash, int n) {
+		if (!bloom_losing_position_info.probably_contains(canonical_hash)) return nullptr;
+
+		return find_losing_unfiltered(canonical_hash, n);
+	}
+
+	static const WinningPositionInfo* find_winning(uint64_t canonical_hash, int n) {
+		auto winning_position = winning_position_info.find(canonical_hash);
+		if (winning_position != winning_position_info.end()) return &winning_position->second;
+
+		return find_spilled(spilled_winning_position_info, canonical_hash, n);
+	}
+
+	// Losing positions of a level published by a solve, sorted by key
+	struct PublishedLevel {
+		std::vector<uint64_t> keys;
+		std::vector<int> dtes;
+	};
+
+	/**
+	 * Losing positions that queries read instead of the tables in memory, which a solve may be changing. A set is never
+	 * modified once published; it is replaced as a whole. Each query holds a reference to the set it started with, so a
+	 * replaced set lives until the last query reading it is done, and a query never sees half of an update
+	 */
+	struct QueryTables {
+		// Mapped table file (see map_table), or nullptr
+		std::shared_ptr<const tablefile::Table> table;
+		// Levels published so far, indexed by n
+		std::vector<std::shared_ptr<const PublishedLevel>> levels;
+		// Every level up to this one is answered, within the bounds
+		int max_level = 0;
+		int bound_width = -1;
+		int bound_height = -1;
+		// Whether the dtes are real rather than all 0
+		bool has_dte = false;
+
+		bool find(uint64_t key, int n, int& dte) const {
+			if (table) return table->find(key, n, dte);
+			if (n < 0 || n >= (int) levels.size() || !levels[n]) return false;
+
+			const PublishedLevel& level = *levels[n];
+			size_t i = spill::interpolation_search(level.keys.data(), level.keys.size(), key);
+			if (i == level.keys.size() || level.keys[i] != key) return false;
+
+			dte = level.dtes[i];
+			return true;
+		}
+
+		void prefetch(uint64_t key, int n) const {
+			if (table) table->prefetch(key, n);
+		}
+	};
+
+	std::atomic<std::shared_ptr<const QueryTables>> query_tables;
+	// Whether query_tables is set, so that queries against the tables in memory skip the reference counting
+	std::atomic<bool> query_tables_set { false };
+
+	using QueryTablesRef = std::shared_ptr<const QueryTables>;
+
+	// The current query tables, for the length of one query, or nullptr to read the tables in memory
+	static QueryTablesRef pin_query_tables() {
+		if (!query_tables_set.load(std::memory_order_acquire)) return nullptr;
+		return query_tables.load();
+	}
+
+	static void publish_query_tables(QueryTablesRef tables) {
+		query_tables.store(std::move(tables));
+		query_tables_set.store(true, std::memory_order_release);
+	}
+
+	// Add a completed level to the query tables, alongside the levels already there
+	static void publish_level(int n, const store::LevelEntries& entries, int bound_width, int bound_height, bool has_dte) {
+		auto level = std::make_shared<PublishedLevel>();
+		level->keys.reserve(entries.size());
+		level->dtes.reserve(entries.size());
+
+		for (const auto& [key, info] : entries) {
+			level->keys.push_back(key);
+			level->dtes.push_back(info.dte);
+		}
+
+		QueryTablesRef current = pin_query_tables();
+		auto tables = current ? std::make_shared<QueryTables>(*current) : std::make_shared<QueryTables>();
+
+		if ((int) tables->levels.size() <= n) tables->levels.resize(n + 1);
+		tables->levels[n] = std::move(level);
+		tables->max_level = n;
+		tables->bound_width = bound_width;
+		tables->bound_height = bound_height;
+		tables->has_dte = has_dte;
+
+		publish_query_tables(std::move(tables));
+	}
+
+	// Whether the tables queries read were solved with compute_dte, so that the dtes they hold are real rather than all 0
+	static bool query_has_dte(const QueryTables* tables) {
+		return tables ? tables->has_dte : solved_region.has_dte;
+	}
+
+	// Whether a canonical hash with n squares is losing, for queries rather than the solver. Sets dte if so
+	static bool query_losing(const QueryTables* tables, uint64_t canonical_hash, int n, int& dte) {
+		if (tables) return tables->find(canonical_hash, n, dte);
+
+		const LosingPositionInfo* info = find_losing(canonical_hash, n);
+		if (info) dte = info->dte;
+
+		return info;
+	}
+
+	// query_losing in three stages, for interleaving many lookups. First, start fetching what the lookup reads first
+	static void query_losing_prefetch(const QueryTables* tables, uint64_t canonical_hash, int n) {
+		if (tables)
+			tables->prefetch(canonical_hash, n);
+		else
+			bloom_losing_position_info.prefetch(canonical_hash);
+	}
+
+	// Second, false if certainly not losing; otherwise start fetching the rest
+	static bool query_losing_candidate(const QueryTables* tables, uint64_t canonical_hash) {
+		if (tables) return true;
+		if (!bloom_losing_position_info.probably_contains(canonical_hash)) return false;
+
+		losing_position_info.prefetch(canonical_hash);
+		return true;
+	}
+
+	// Last, the lookup itself, for a candidate
+	static bool query_losing_resolve(const QueryTables* tables, uint64_t canonical_hash, int n, int& dte) {
+		if (tables) return tables->find(canonical_hash, n, dte);
+
+		const LosingPositionInfo* info = find_losing_unfiltered(canonical_hash, n);
+		if (info) dte = info->dte;
+
+		return info;
+	}
+
+	// The winning side table for queries. Query tables have none, so their winning positions are answered from their children
+	static const WinningPositionInfo* query_winning(const QueryTables* tables, uint64_t canonical_hash, int n) {
+		return tables ? nullptr : find_winning(canonical_hash, n);
+	}
+
+	// Whether a position is losing, consulting the oracle before the table. Sets dte if so
+	static bool is_losing(const QueryTables* tables, const Position& p, int& dte) {
+		oracle::Answer answer = oracle::query(p);
+
+		if (answer.known()) {
+			dte = answer.dte;
+			return !answer.is_winning;
+		}
+
+		return query_losing(tables, p.canonical_hash(), p.square_count(), dte);
+	}
 
 	PositionInfo Position::info() const {
-		if (height == 0) return { .is_winning=true, .dte=0 };
+		// Also handles the empty position
+		oracle::Answer answer = oracle::query(*this);
+		if (answer.known() && answer.dte >= 0) return { .is_winning=answer.is_winning, .dte=answer.dte };
 
-		uint64_t canonical_hash = this->canonical_hash();
+		QueryTablesRef tables = pin_query_tables();
 
-		bool definitely_contains = bloom_losing_position_info.probably_contains(canonical_hash);
+		// Only whether the position is winning can be found, which needs no scan
+		if (!query_has_dte(tables.get())) {
+			int dte;
+			bool is_winning = answer.known() ? answer.is_winning
+			                                 : !query_losing(tables.get(), canonical_hash(), square_count(), dte);
 
-		if (definitely_contains) {
-			auto losing_position = losing_position_info.find(canonical_hash);
+			return { .is_winning=is_winning, .dte=PositionInfo::UNKNOWN_DTE };
+		}
 
-			if (losing_position != losing_position_info.end()) return { .is_winning=false, .dte=losing_position->second.dte };
+		if (!answer.known()) {
+			int dte;
+			if (query_losing(tables.get(), canonical_hash(), square_count(), dte)) return { .is_winning=false, .dte=dte };
+
+			const WinningPositionInfo* winning_position = query_winning(tables.get(), canonical_hash(), square_count());
+			if (winning_position && winning_position->dte != WinningPositionInfo::NOT_COMPUTED)
+				return { .is_winning=true, .dte=winning_position->dte };
 		}
 
 		// Winning position
 		int min_dte = INT_MAX;
 
 		for_each_cut([&] (Cut c) {
-			Position cutted = cut(c);
-			canonical_hash = cutted.canonical_hash();
-			if (bloom_losing_position_info.probably_contains(canonical_hash)) {
-				auto cutted_info = losing_position_info.find(canonical_hash);
-
-				if (cutted_info != losing_position_info.end()) {
-					// For all losing cuts
-					int dte = cutted_info->second.dte;
-					min_dte = std::min(dte+1, min_dte);
-				}
-			}
+			int dte;
+			// For all losing cuts
+			if (is_losing(tables.get(), cut(c), dte))
+				min_dte = std::min(dte+1, min_dte);
 		});
 
 		return { .is_winning=true, .dte=min_dte };
 	}
 
-	std::atomic<int> num_positions;
-	std::atomic<int> num_winning_moves;
-	std::atomic<int> num_losing_positions;
+	using position_iterator = PositionBatch::iterator;
+
+	// Probe progress of a child key
+	enum class ProbeState : uint8_t
+	{
+		UNKNOWN, // key computed, bloom block prefetched
+		CANDIDATE, // in the bloom filter, map group prefetched
+		MISS,
+		LOSING,
+		ANSWERED // by the oracle, or left to the children (info_batch)
+	};
+
+	// Scratch space of one solver worker. It lives for the whole solve, so that once its vectors have grown to the largest
+	// batch and level, processing a position allocates nothing
+	template <typename Stats>
+	struct WorkerScratch {
+		std::vector<PositionView> order;
+		std::vector<uint64_t> keys;
+		std::vector<ProbeState> key_states;
+		// dte of each child key, or -1 if it has to be looked up
+		std::vector<int> key_dtes;
+
+		// Positions found in the current batch, to be inserted into the tables once the batch is done
+		std::vector<std::pair<uint64_t, LosingPositionInfo>> losing;
+		std::vector<std::pair<uint64_t, WinningPositionInfo>> winning;
+		// Codes and dtes of the batch's losing positions, with HashPositionOptions::catalog_file
+		std::vector<uint8_t> catalog_codes;
+		std::vector<uint16_t> catalog_dtes;
+
+		// This worker's share of the batch statistics
+		Stats stats;
+	};
+
+	// Squares left after the index-th cut, in for_each_cut order, of a position with n squares
+	static int nth_child_square_count(const PositionView& p, int n, int index) {
+		int row = 0;
+		while (index >= p[row]) index -= p[row++];
+
+		// The cut takes every square at or above row and right of column index
+		for (; row < p.height && p[row] > index; ++row) n -= p[row] - index;
+
+		return n;
+	}
+
+	template <typename Stats>
+	void hash_positions_over_iterator(WorkerScratch<Stats>& scratch, position_iterator begin, position_iterator end, HashPositionOptions opts={}) {
+		uint64_t probes_eliminated = 0, stores_eliminated = 0;
+		Stats& stats = scratch.stats;
+		// Levels are only spilled between batches
+		bool spilled = !spilled_losing_position_info.empty() || !spilled_winning_position_info.empty();
+
+		auto add_to_catalog = [&] (const PositionView& p, int dte) {
+			if (!opts.catalog_file) return;
+
+			catalog::encode(p, scratch.catalog_codes);
+			scratch.catalog_dtes.push_back((opts.compute_dte && dte >= 0) ? (uint16_t) dte : catalog::NO_DTE);
+		};
+
+		// Visit the positions in order of height, so that the batch kernel can hash the children of a whole lane group of
+		// positions at once. A lane group is also the unit of prefetching: its children's keys (one per square of each
+		// position) are all in flight before any is resolved.
+		std::vector<PositionView>& order = scratch.order;
+		order.resize(end - begin);
+		{
+			size_t height_begin[MAX_HEIGHT + 2] = {};
+			for (auto it = begin; it != end; ++it) height_begin[(*it).height + 1]++;
+			for (int h = 0; h <= MAX_HEIGHT; ++h) height_begin[h + 1] += height_begin[h];
+			for (auto it = begin; it != end; ++it) order[height_begin[(*it).height]++] = *it;
+		}
+
+		simd::PositionLanes lanes;
+		simd::LaneHashes lane_hashes;
+		PositionView group[simd::LANES];
+
+		// Child keys of the lane group, with the kth position's at [key_begin[k], key_begin[k + 1])
+		std::vector<uint64_t>& keys = scratch.keys;
+		std::vector<ProbeState>& key_states = scratch.key_states;
+		std::vector<int>& key_dtes = scratch.key_dtes;
+		ptrdiff_t key_begin[simd::LANES + 1];
+
+		for (size_t next = 0; next < order.size(); ) {
+			// Gather up to LANES positions of the same height that the oracle can't answer
+			int height = order[next].height;
+			int count = 0;
+
+			while (count < simd::LANES && next < order.size() && order[next].height == height) {
+				PositionView p = order[next++];
+				int multiplicity = (p.o == Orientation::CANONICAL) ? 2 : 1;
+
+				stats.add_position(multiplicity);
+
+				// Solved families are answered without probing any cuts, and never stored
+				oracle::Answer answer = oracle::query(p);
+				if (answer.known() && answer.winning_cuts >= 0) {
+					probes_eliminated += p.square_count();
+
+					if (answer.is_winning) {
+						stats.add_winning(answer.winning_cuts, multiplicity);
+					} else {
+						stats.add_losing(multiplicity);
+						stores_eliminated++;
+						add_to_catalog(p, answer.dte);
+					}
+
+					continue;
+				}
+
+				group[count++] = p;
+			}
+
+			if (count == 0) continue;
+
+			lanes.height = height;
+			lanes.count = count;
+
+			key_begin[0] = 0;
+			for (int k = 0; k < count; ++k) key_begin[k + 1] = key_begin[k] + group[k].square_count();
+
+			for (int i = 0; i < height; ++i) {
+				for (int k = 0; k < simd::LANES; ++k)
+					lanes.rows[i][k] = (k < count) ? group[k].rows[i] : 0;
+			}
+
+			keys.resize(key_begin[count]);
+			key_states.resize(key_begin[count]);
+			if (opts.compute_dte) key_dtes.assign(key_begin[count], -1);
+
+			// Pass 1: hash every child, one cut at a time across the lanes, and start fetching its bloom block
+			ptrdiff_t cursor[simd::LANES];
+			std::copy(key_begin, key_begin + count, cursor);
 
-	using position_iterator = std::vector<Position>::iterator;
-	void hash_positions_over_iterator(map_type& map, std::vector<uint64_t>& bloomqueue, position_iterator begin, position_iterator end, HashPositionOptions opts={}) {
-		std::vector<Position> cutted_list;
+			for (int row = 0; row < height; ++row) {
+				int max_col = *std::max_element(lanes.rows[row], lanes.rows[row] + count);
 
-		for (auto it = begin; it != end; ++it) {
-			Position p = *it;
+				for (int col = 0; col < max_col; ++col) {
+					simd::active->lane_cut_hashes(lanes, row, col, lane_hashes);
 
-			bool is_winning = false;
-			int multiplicity = (p.o == Orientation::CANONICAL) ? 2 : 1;
+					for (uint32_t lanes_left = lane_hashes.valid; lanes_left; lanes_left &= lanes_left - 1) {
+						int k = __builtin_ctz(lanes_left);
+						ptrdiff_t i = cursor[k]++;
 
-			num_positions += multiplicity;
+						if (lane_hashes.special & (1u << k)) {
+							Position cutted = group[k].cut(row, col);
+							oracle::Answer cutted_answer = oracle::query(cutted);
 
-			p.for_each_cut([&] (Cut c) {
-				Position cutted = p.cut(c);
-				
-				if (opts.compute_dte) cutted_list.push_back(cutted);
+							if (cutted_answer.known()) {
+								probes_eliminated++;
+								key_states[i] = cutted_answer.is_winning ? ProbeState::MISS : ProbeState::LOSING;
 
-				uint64_t canonical_hash = cutted.canonical_hash();
+								if (opts.compute_dte) {
+									key_dtes[i] = cutted_answer.dte;
+									// Rectangles have their dte in the side table
+									if (cutted_answer.dte < 0) keys[i] = cutted.canonical_hash();
+								}
 
-				if (bloom_losing_position_info.probably_contains(canonical_hash)) {
-					auto cutted_info = losing_position_info.find(canonical_hash);
+								continue;
+							}
 
-					if (cutted_info != losing_position_info.end()) {
-						is_winning = true;
-						num_winning_moves += multiplicity;
+							keys[i] = cutted.canonical_hash();
+						} else {
+							keys[i] = lane_hashes.hashes[k];
+						}
+
+						bloom_losing_position_info.prefetch(keys[i]);
+						key_states[i] = ProbeState::UNKNOWN;
 					}
 				}
-			});
+			}
 
-			int max_dte = 0;
-			if (!is_winning && opts.compute_dte) {
-				for (Position& cutted : cutted_list) {
-					int dte = cutted.info().dte;
+			// Pass 2: test the (now cached) bloom blocks and start fetching the map groups of the candidates. With compute_dte,
+			// winning children are certain to be looked up too
+			for (size_t i = 0; i < keys.size(); ++i) {
+				if (key_states[i] != ProbeState::UNKNOWN) {
+					if (opts.compute_dte && key_dtes[i] < 0) winning_position_info.prefetch(keys[i]);
+					continue;
+				}
 
-					max_dte = std::max(dte+1, max_dte);
+				if (bloom_losing_position_info.probably_contains(keys[i])) {
+					key_states[i] = ProbeState::CANDIDATE;
+					losing_position_info.prefetch(keys[i]);
+				} else {
+					key_states[i] = ProbeState::MISS;
+					if (opts.compute_dte) winning_position_info.prefetch(keys[i]);
 				}
 			}
 
-			if (!is_winning) {
-				uint64_t h = p.canonical_hash();
-				map[h] = { .dte = max_dte };
-				bloomqueue.push_back(h);
-				// bloom_losing_position_info.query(h);
-				num_losing_positions += multiplicity;
+			// Pass 3: resolve each position. Every child is on an earlier level, so with compute_dte its dte is in one of the
+			// tables already: a losing position is one more than its slowest child, a winning one one more than its fastest
+			// losing child
+			for (int k = 0; k < count; ++k) {
+				int multiplicity = (group[k].o == Orientation::CANONICAL) ? 2 : 1;
+				int level = key_begin[k + 1] - key_begin[k]; // one child per square
+				int winning_moves = 0;
+				int min_losing_dte = INT_MAX, max_dte = 0;
+				// Child keys are in cut order, so a child's offset is its cut's index
+				int best_cut = -1;
+
+				for (ptrdiff_t i = key_begin[k]; i < key_begin[k + 1]; ++i) {
+					const LosingPositionInfo* losing_child = nullptr;
+					// Only the spilled runs need the child's level, which takes a walk over the rows
+					int child_level = spilled ? nth_child_square_count(group[k], level, (int) (i - key_begin[k])) : -1;
+
+					if (key_states[i] == ProbeState::CANDIDATE) {
+						losing_child = find_losing_unfiltered(keys[i], child_level);
+						if (losing_child) key_states[i] = ProbeState::LOSING;
+					}
+
+					bool child_losing = key_states[i] == ProbeState::LOSING;
+					if (child_losing) winning_moves++;
+
+					if (!opts.compute_dte) continue;
+
+					int dte = key_dtes[i];
+					if (dte < 0) {
+						if (losing_child) {
+							dte = losing_child->dte;
+						} else {
+							const WinningPositionInfo* winning_child = find_winning(keys[i], child_level);
+							if (!winning_child)
+								throw std::runtime_error(FILE_LINE"Child of a position has no dte");
+
+							dte = winning_child->dte;
+						}
+					}
+
+					if (child_losing && dte + 1 < min_losing_dte) {
+						min_losing_dte = dte + 1;
+						best_cut = (int) (i - key_begin[k]);
+					}
+					max_dte = std::max(max_dte, dte + 1);
+				}
+
+				if (winning_moves) {
+					stats.add_winning(winning_moves, multiplicity);
+
+					if (opts.compute_dte || opts.compute_winning_moves || opts.compute_best_moves) {
+						WinningPositionInfo info;
+						info.level = level;
+						if (opts.compute_dte) info.dte = (uint16_t)min_losing_dte;
+						if (opts.compute_winning_moves) info.winning_cuts = (uint16_t)winning_moves;
+						if (opts.compute_best_moves) info.best_cut = (uint16_t)best_cut;
+
+						scratch.winning.push_back({ group[k].to_position().canonical_hash(), info });
+					}
+
+					continue;
+				}
+
+				scratch.losing.push_back({ group[k].to_position().canonical_hash(), { .dte = max_dte, .level = level } });
+				stats.add_losing(multiplicity);
+				add_to_catalog(group[k], max_dte);
 			}
+		}
+
+		oracle::stats.probes_eliminated += probes_eliminated;
+		oracle::stats.stores_eliminated += stores_eliminated;
+	}
+
+	// A batch of positions of level n on its way from the enumerator to the solver
+	struct PipelineBatch {
+		PositionBatch positions;
+		int n;
+		// Whether this is the last batch of level n
+		bool last;
+	};
+
+	// Thrown inside the enumerator to unwind it once the solver has stopped taking batches
+	struct EnumerationStopped {};
+
+	bool SolvedRegion::contains(int n, int width, int height) const {
+		return n <= max_squares && (bound_width < 0 || width <= bound_width) && (bound_height < 0 || height <= bound_height);
+	}
+
+	// Bytes held by the tables, including empty slots and control bytes
+	static size_t table_memory() {
+		return losing_position_info.capacity() * (sizeof(map_type::value_type) + 1)
+			+ winning_position_info.capacity() * (sizeof(winning_map_type::value_type) + 1);
+	}
+
+	// Move every entry of the chosen levels out of the table into the level's spilled run
+	template <typename Map, typename Info>
+	static void spill_table(Map& table, std::vector<spill::Run<Info>>& runs, const std::vector<bool>& chosen,
+	                        const char* name, const char* directory) {
+		static int sequence = 0;
+		std::vector<std::vector<std::pair<uint64_t, Info>>> entries(chosen.size());
+
+		for (size_t i = 0; i < Map::subcnt(); ++i) {
+			table.with_submap_m(i, [&] (auto& submap) {
+				for (auto it = submap.begin(); it != submap.end(); ) {
+					int level = it->second.level;
+
+					if (level > 0 && (size_t) level < chosen.size() && chosen[level]) {
+						entries[level].push_back(*it);
+						submap.erase(it++);
+					} else {
+						++it;
+					}
+				}
+			});
+		}
 
-			cutted_list.clear();
+		for (size_t level = 0; level < entries.size(); ++level) {
+			if (entries[level].empty()) continue;
+			if (runs.size() <= level) runs.resize(level + 1);
+
+			runs[level].add(std::string(directory) + "/" + name + "_" + std::to_string(level) + "_"
+			                + std::to_string(sequence++) + ".run", entries[level]);
 		}
+
+		// Give the memory back
+		table.rehash(0);
+	}
+
+	/**
+	 * Spill the largest completed levels until the tables are back under three quarters of the budget, leaving room to
+	 * grow before the next spill. The level being completed stays, as the next levels probe it the most
+	 * @param resident Entries of each level still in the tables
+	 */
+	static void spill_levels(int current_level, std::vector<uint64_t>& resident, const HashPositionOptions& opts) {
+		uint64_t entries = losing_position_info.size() + winning_position_info.size();
+		if (entries == 0) return;
+
+		double bytes_per_entry = (double) table_memory() / entries;
+		size_t target = opts.table_memory_budget / 4 * 3;
+
+		std::vector<int> candidates;
+		for (int level = 1; level < current_level && level < (int) resident.size(); ++level)
+			if (resident[level]) candidates.push_back(level);
+
+		std::sort(candidates.begin(), candidates.end(), [&] (int a, int b) { return resident[a] > resident[b]; });
+
+		std::vector<bool> chosen(resident.size());
+		uint64_t spilled = 0;
+
+		for (int level : candidates) {
+			if ((entries - spilled) * bytes_per_entry <= target) break;
+
+			chosen[level] = true;
+			spilled += resident[level];
+			resident[level] = 0;
+		}
+
+		if (!spilled) return;
+
+		spill_table(losing_position_info, spilled_losing_position_info, chosen, "losing", opts.spill_directory);
+		spill_table(winning_position_info, spilled_winning_position_info, chosen, "winning", opts.spill_directory);
+
+		std::printf("Spilled %llu entries; tables now take %zu bytes\n", (unsigned long long) spilled, table_memory());
+	}
+
+	static void rebuild_bloom_filter() {
+		for (const auto& element : losing_position_info)
+			bloom_losing_position_info.insert(element.first);
+	}
+
+	// Whether bounds b admit everything bounds a do
+	static bool bound_covers(int b, int a) {
+		return b < 0 || (a >= 0 && a <= b);
 	}
 
 	void hash_positions(int max_squares, int bound_width, int bound_height, HashPositionOptions opts) {
+		extend_positions({}, max_squares, bound_width, bound_height, opts);
+	}
+
+	void extend_positions(SolvedRegion solved, int max_squares, int bound_width, int bound_height, HashPositionOptions opts) {
 		const unsigned POSITION_BATCH_SIZE = 1000000; // how many positions to process at once
 		const int NUM_THREADS = 8;
+		const int MAX_PIPELINE_BATCHES = 64;
 
-		std::vector<Position> positions;
+		bool resumed = false;
 
-		auto process_positions = [&] {
-			size_t size = positions.size();
+		if (opts.resume && opts.checkpoint) {
+			store::CheckpointMetadata checkpoint;
 
-			if (size > 10000) {
-				std::vector<std::thread> threads;
+			if (store::read_checkpoint(checkpoint, losing_position_info, winning_position_info, opts.checkpoint)) {
+				if (checkpoint.compute_dte != opts.compute_dte || checkpoint.compute_winning_moves != opts.compute_winning_moves
+				    || checkpoint.compute_best_moves != opts.compute_best_moves
+				    || !bound_covers(bound_width, checkpoint.bound_width) || !bound_covers(bound_height, checkpoint.bound_height))
+					throw std::runtime_error(FILE_LINE"Checkpoint was solved with different options or larger bounds");
 
-				// Divvy up the work, with size/NUM_THREADS each
-				int positions_per_thread = size / NUM_THREADS;
+				oracle::stats.probes_eliminated = checkpoint.probes_eliminated;
+				oracle::stats.stores_eliminated = checkpoint.stores_eliminated;
 
-				position_iterator begin = positions.begin();
-				//map_type map1, map2, map3, map4;
-				std::vector<map_type*> maps;
-				std::vector<std::vector<uint64_t>*> bloomqueues;
+				// The filter is a function of the losing keys, so rebuilding it restores it exactly
+				rebuild_bloom_filter();
 
-				for (int i = 0; i < NUM_THREADS; ++i) {
-					position_iterator end = (i == NUM_THREADS - 1) ? positions.end() : (begin + positions_per_thread);
-					map_type* thread_map = new map_type{};
-					std::vector<uint64_t>* thread_bloomqueue;
+				// A checkpoint with smaller bounds is extended like any other solved table
+				solved = { checkpoint.completed_level, checkpoint.bound_width, checkpoint.bound_height,
+				           checkpoint.compute_dte != 0 };
+				resumed = true;
+			}
+		}
 
-					maps.push_back(thread_map);
-					bloomqueues.push_back(thread_bloomqueue);
+		if (solved.max_squares > 0 && (!bound_covers(bound_width, solved.bound_width) || !bound_covers(bound_height, solved.bound_height)))
+			throw std::runtime_error(FILE_LINE"Can't extend a table to smaller bounds");
 
-					std::thread thread ([=] (map_type* map, std::vector<uint64_t>* bloomqueue) {
-						hash_positions_over_iterator(*map, *bloomqueue, begin, end);
-					}, maps.back(), bloomqueues.back());
+		// Children on solved levels take their dtes from the tables, so they must have them. Level 1's are all known
+		if (opts.compute_dte && solved.max_squares > 1 && !solved.has_dte)
+			throw std::runtime_error(FILE_LINE"Can't compute dtes on top of a table solved without them");
 
-					threads.push_back(std::move(thread));
+		// With the same bounds, the solved levels have nothing left to add
+		int first_level = 1;
+		if (solved.bound_width == bound_width && solved.bound_height == bound_height)
+			first_level = solved.max_squares + 1;
 
-					begin = end;
-				}
+		if (resumed) std::printf("Resuming from level %i\n", first_level);
+
+		datastructs::WorkerPool pool(NUM_THREADS);
+		std::vector<WorkerScratch<stats::Policy>> scratch(NUM_THREADS);
+
+		// Level-completion hook: finished levels go to the writer thread while the next one is solved
+		std::unique_ptr<tablefile::Writer> table_writer;
+		std::unique_ptr<store::LevelWriter> level_writer;
+		store::LevelEntries level_losing;
+
+		// Catalog levels are already encoded by the workers, so they are written here rather than on the writer thread
+		std::unique_ptr<catalog::Writer> catalog_writer;
+		std::vector<uint8_t> level_catalog_codes;
+		std::vector<uint16_t> level_catalog_dtes;
 
-				for (auto &thread : threads) {
-					thread.join();
+		// Entries each level has in the tables, for choosing what to spill
+		std::vector<uint64_t> resident(max_squares + 1);
+		uint64_t resident_before_level = losing_position_info.size() + winning_position_info.size();
+
+		// The recorded cut is the quickest win, which takes the children's dtes to pick
+		if (opts.compute_best_moves && !opts.compute_dte)
+			throw std::runtime_error(FILE_LINE"Best moves need compute_dte");
+
+		if (opts.checkpoint && opts.checkpoint_interval < 1)
+			throw std::runtime_error(FILE_LINE"The checkpoint interval must be at least 1");
+
+		if (opts.table_memory_budget) {
+			if (!opts.spill_directory)
+				throw std::runtime_error(FILE_LINE"A table memory budget needs a spill directory");
+			// A checkpoint only covers the tables in memory
+			if (opts.checkpoint)
+				throw std::runtime_error(FILE_LINE"Checkpoints can't be combined with spilling");
+		}
+
+		if (opts.level_directory) {
+			// Only the new positions of each level go through the hook, and each would replace the level's whole file
+			if (first_level != 1 || solved.max_squares > 0)
+				throw std::runtime_error(FILE_LINE"Level files can only be written by a solve from level 1");
+		}
+
+		if (opts.table_file) {
+			// Only the new positions of each level go through the hook
+			if (first_level != 1 || solved.max_squares > 0)
+				throw std::runtime_error(FILE_LINE"A table file can only be written by a solve from level 1");
+
+			table_writer = std::make_unique<tablefile::Writer>(opts.table_file, max_squares, bound_width, bound_height, opts.compute_dte);
+		}
+
+		if (opts.catalog_file) {
+			if (first_level != 1 || solved.max_squares > 0)
+				throw std::runtime_error(FILE_LINE"A catalog can only be written by a solve from level 1");
+
+			catalog_writer = std::make_unique<catalog::Writer>(opts.catalog_file, max_squares, bound_width, bound_height, opts.compute_dte);
+		}
+
+		if (opts.publish_levels) {
+			if (first_level != 1 || solved.max_squares > 0)
+				throw std::runtime_error(FILE_LINE"Levels can only be published by a solve from level 1");
+
+			// Queries stop reading the tables in memory before the solver starts changing them
+			auto tables = std::make_shared<QueryTables>();
+			tables->bound_width = bound_width;
+			tables->bound_height = bound_height;
+
+			publish_query_tables(std::move(tables));
+		}
+
+		if (opts.level_directory || opts.table_file || opts.publish_levels) {
+			level_writer = std::make_unique<store::LevelWriter>([&] (int n, const store::LevelEntries& entries) {
+				if (opts.publish_levels) publish_level(n, entries, bound_width, bound_height, opts.compute_dte);
+				if (opts.level_directory) store::write_level(opts.level_directory, n, entries);
+				if (table_writer) table_writer->add_level(n, entries);
+			});
+		}
+		stats::Policy level_stats;
+
+		auto process_positions = [&] (PositionBatch& positions) {
+			size_t size = positions.size();
+
+			// Small batches aren't worth waking the workers for
+			int workers = (size > 10000) ? NUM_THREADS : 1;
+			size_t positions_per_worker = size / workers;
+
+			// Divvy up the work, with size/workers each
+			auto work = [&] (int worker) {
+				if (worker >= workers) return;
+
+				position_iterator begin = positions.begin() + worker * positions_per_worker;
+				position_iterator end = (worker == workers - 1) ? positions.end() : (begin + positions_per_worker);
+
+				hash_positions_over_iterator(scratch[worker], begin, end, opts);
+			};
+
+			if (workers == 1)
+				work(0);
+			else
+				pool.run(work);
+
+			for (WorkerScratch<stats::Policy>& s : scratch) {
+				level_stats.merge(s.stats);
+				s.stats.clear();
+
+				for (const auto& [hash, info] : s.losing) {
+					losing_position_info[hash] = info;
+					bloom_losing_position_info.insert(hash);
 				}
 
-				for (map_type* map : maps) {
-					losing_position_info.merge(*map);
+				if (level_writer) level_losing.insert(level_losing.end(), s.losing.begin(), s.losing.end());
+				s.losing.clear();
 
-					delete map;
+				for (const auto& [hash, info] : s.winning)
+					winning_position_info[hash] = info;
+
+				s.winning.clear();
+
+				if (catalog_writer) {
+					level_catalog_codes.insert(level_catalog_codes.end(), s.catalog_codes.begin(), s.catalog_codes.end());
+					level_catalog_dtes.insert(level_catalog_dtes.end(), s.catalog_dtes.begin(), s.catalog_dtes.end());
+
+					s.catalog_codes.clear();
+					s.catalog_dtes.clear();
 				}
+			}
+		};
 
-				for (std::vector<uint64_t>* bloomqueue : bloomqueues) {
-					for (uint64_t hash : *bloomqueue) {
-						bloom_losing_position_info.insert(hash);
+		// Enumeration runs on its own thread, ahead of the solver. Batches go to the solver through full and come back
+		// through empty; the enumerator only allocates another batch while the batches so far fit in the memory budget,
+		// and otherwise waits for one to come back. If enumeration fails, a nullptr follows the batches on full, with room
+		// for it however many batches are there, and publishes enumeration_error.
+		std::vector<std::unique_ptr<PipelineBatch>> batches;
+		datastructs::SpscRing<PipelineBatch*> full(MAX_PIPELINE_BATCHES + 1), empty(MAX_PIPELINE_BATCHES);
+		std::exception_ptr enumeration_error;
+		// Set by the solver when it leaves early; a nullptr on empty wakes the enumerator if it is waiting for a batch
+		std::atomic<bool> stop_enumeration{false};
+
+		std::thread enumerator([&] {
+			size_t largest_batch_memory = 0;
+
+			auto take_empty = [&] {
+				PipelineBatch* batch;
+
+				if (!empty.try_pop(batch)) {
+					if (batches.size() < 2 || (batches.size() < MAX_PIPELINE_BATCHES
+					                           && (batches.size() + 1) * largest_batch_memory <= opts.batch_memory_budget)) {
+						batches.push_back(std::make_unique<PipelineBatch>());
+						return batches.back().get();
 					}
 
-					delete bloomqueue;
+					batch = empty.pop();
 				}
-			} else {
-				std::vector<uint64_t> bloomqueue;
-				
-				hash_positions_over_iterator(losing_position_info, bloomqueue, positions.begin(), positions.end(), opts);
 
-				for (uint64_t hash : bloomqueue) {
-					bloom_losing_position_info.insert(hash);
+				if (!batch) throw EnumerationStopped();
+				return batch;
+			};
+
+			auto send = [&] (PipelineBatch* batch, int n, bool last) {
+				batch->n = n;
+				batch->last = last;
+				largest_batch_memory = std::max(largest_batch_memory, batch->positions.memory_usage());
+
+				full.push(batch);
+			};
+
+			// Owned by the enumerator until sent, and nullptr once sent until the next is taken, so a failure in between
+			// never touches a batch the solver has
+			PipelineBatch* batch = nullptr;
+
+			try {
+				batch = take_empty();
+
+				for (int n = first_level; n <= max_squares; ++n) {
+					get_positions_with_n_tiles(n, [&] (const Position& p) {
+						if (stop_enumeration.load(std::memory_order_relaxed)) throw EnumerationStopped();
+						// Only newly admitted shapes on solved levels
+						if (solved.contains(n, p.get_width(), p.get_height())) return;
+
+						batch->positions.push_back(p);
+
+						// Process positions in batches
+						if (batch->positions.size() > POSITION_BATCH_SIZE) {
+							send(batch, n, false);
+							batch = nullptr;
+							batch = take_empty();
+						}
+					}, bound_width, bound_height, true /* only canonical positions */);
+
+					// Remaining positions
+					send(batch, n, true);
+					batch = nullptr;
+					if (n < max_squares) batch = take_empty();
 				}
+			} catch (const EnumerationStopped&) {
+				// Nobody is waiting for batches
+			} catch (...) {
+				enumeration_error = std::current_exception();
+				full.push(nullptr);
 			}
-		};
+		});
 
-		for (int n = 1; n <= max_squares; ++n) {
-			num_winning_moves = num_positions = num_losing_positions = 0;
+		// However the solver leaves, the enumerator is stopped and joined before the state it uses goes away
+		struct EnumeratorGuard {
+			std::thread& enumerator;
+			std::atomic<bool>& stop;
+			datastructs::SpscRing<PipelineBatch*>& empty;
 
-			get_positions_with_n_tiles(n, [&] (const Position& p) {
-				positions.push_back(p);
+			~EnumeratorGuard() {
+				if (!enumerator.joinable()) return;
 
-				// Process positions in batches
-				if (positions.size() > POSITION_BATCH_SIZE) {
-					process_positions();
-					positions.clear();
-				}
-			}, bound_width, bound_height, true /* only canonical positions */);
+				stop.store(true, std::memory_order_relaxed);
+				// If empty is full, the enumerator has batches to take and will see stop
+				empty.try_push(nullptr);
+				enumerator.join();
+			}
+		} enumerator_guard { enumerator, stop_enumeration, empty };
+
+		for (int n = first_level; n <= max_squares; ++n) {
+			level_stats.clear();
+			auto level_begin = std::chrono::steady_clock::now();
+			uint64_t level_allocations = alloc_counter::count();
+
+			bool last = false;
+			while (!last) {
+				PipelineBatch* batch = full.pop();
+				if (!batch) std::rethrow_exception(enumeration_error);
+
+				process_positions(batch->positions);
+				last = batch->last;
+
+				batch->positions.clear();
+				empty.push(batch);
+			}
+
+			auto level_end = std::chrono::steady_clock::now();
+			long long level_ms = std::chrono::duration_cast<std::chrono::milliseconds>(level_end - level_begin).count();
+
+			// Heap allocations made while solving the level. Zero in the steady state, apart from the table's own growth
+			level_allocations = alloc_counter::count() - level_allocations;
+
+			level_stats.print_level(n, level_ms, level_allocations);
+
+			if (level_writer) {
+				level_writer->submit(n, std::move(level_losing));
+				level_losing = {};
+			}
+
+			if (catalog_writer) {
+				catalog_writer->add_level(n, level_catalog_codes, level_catalog_dtes);
+				level_catalog_codes.clear();
+				level_catalog_dtes.clear();
+			}
+
+			uint64_t resident_after_level = losing_position_info.size() + winning_position_info.size();
+			resident[n] = resident_after_level - resident_before_level;
+
+			if (opts.table_memory_budget && table_memory() > opts.table_memory_budget)
+				spill_levels(n, resident, opts);
 
-			// Process remaining positions
-			process_positions();
-			positions.clear();
+			resident_before_level = losing_position_info.size() + winning_position_info.size();
 
-			//std::printf("%i\t%f\n", n, num_winning_moves / (float) num_positions);
-			std::printf("%i %i %i %i\n", n, (int)num_positions, (int)num_winning_moves, (int)num_losing_positions);
+			if (opts.checkpoint && (n % opts.checkpoint_interval == 0 || n == max_squares)) {
+				store::CheckpointMetadata checkpoint = {
+					.completed_level = n,
+					.bound_width = bound_width,
+					.bound_height = bound_height,
+					.compute_dte = opts.compute_dte,
+					.compute_winning_moves = opts.compute_winning_moves,
+					.compute_best_moves = opts.compute_best_moves,
+					.probes_eliminated = oracle::stats.probes_eliminated,
+					.stores_eliminated = oracle::stats.stores_eliminated
+				};
+
+				store::write_checkpoint(checkpoint, losing_position_info, winning_position_info, opts.checkpoint);
+			}
 		}
+
+		enumerator.join();
+
+		// Wait for the last levels to be written, and report the writer's failure here rather than losing it
+		if (level_writer) level_writer->finish();
+		level_writer.reset();
+		if (table_writer) table_writer->finish();
+		if (catalog_writer) catalog_writer->finish();
+
+		solved_region = { max_squares, bound_width, bound_height, opts.compute_dte };
+
+		std::printf("Oracle eliminated %llu probes and %llu stored entries\n",
+		            (unsigned long long)oracle::stats.probes_eliminated, (unsigned long long)oracle::stats.stores_eliminated);
 	}
 
 	std::vector<Cut> Position::winning_cuts() const {
@@ -333,6 +1028,21 @@ namespace Chomp {
 	}
 
 	int Position::num_winning_cuts() const {
+		oracle::Answer answer = oracle::query(*this);
+		if (answer.winning_cuts >= 0) return answer.winning_cuts;
+
+		QueryTablesRef tables = pin_query_tables();
+
+		uint64_t hash = canonical_hash();
+		const WinningPositionInfo* winning_position = query_winning(tables.get(), hash, square_count());
+		if (winning_position && winning_position->winning_cuts != WinningPositionInfo::NOT_COMPUTED)
+			return winning_position->winning_cuts;
+
+		int dte;
+		if (query_losing(tables.get(), hash, square_count(), dte)) return 0;
+
+		// Not in the tables, so scan
+
 		int ret = 0;
 
 		for_each_cut([&] (Cut c) {
@@ -344,36 +1054,227 @@ namespace Chomp {
 		return ret;
 	}
 
+	Cut Position::nth_cut(int index) const {
+		for (int row = 0; row < height; ++row) {
+			if (index < rows[row]) return { row, index };
+			index -= rows[row];
+		}
 
-	uint64_t hash_position(const Position &p) {
-		// It isn't the greatest hash function, but it works. The hash function *is* dependent on MAX_HEIGHT
-		const int *rows = p.rows;
+		throw std::runtime_error(FILE_LINE"Cut index out of range");
+	}
 
-		uint64_t hash = 0;
-		for (int i = 0; i < p.height; ++i) {
-			hash += rows[i];
-			hash *= 179424673L;
-		}
+	Cut Position::recorded_best_move() const {
+		QueryTablesRef tables = pin_query_tables();
+		const WinningPositionInfo* winning_position = query_winning(tables.get(), canonical_hash(), square_count());
+
+		if (!winning_position || winning_position->best_cut == WinningPositionInfo::NOT_COMPUTED) return { -1, -1 };
+
+		// The index is of a cut on the canonical orientation
+		Cut c = canonical().nth_cut(winning_position->best_cut);
+		if (_is_canonical() == Orientation::NOT_CANONICAL) std::swap(c.first, c.second);
 
-		return hash;
+		return c;
 	}
 
-	// Return the hash of the flipped position
-	uint64_t hash_flipped_position(const Position &p) {
-		int col = 0;
-		uint64_t hash = 0;
+	Cut Position::best_move() const {
+		Cut recorded = recorded_best_move();
+		if (recorded.first >= 0) return recorded;
 
-		for (int i = p.height - 1; i >= 0; --i) {
-			int row = p.rows[i];
+		if (!query_has_dte(pin_query_tables().get())) throw std::runtime_error(FILE_LINE"Best moves need tables with dtes");
 
-			while (row > col) {
-				hash += i + 1;
-				hash *= 179424673L;
-				col++;
+		Cut quickest_win = { -1, -1 }, longest_loss = { -1, -1 };
+		int min_losing_dte = INT_MAX, max_dte = -1;
+
+		// A position is winning iff it has a losing child, so one pass over the children finds both candidates
+		for_each_cut([&] (Cut c) {
+			PositionInfo child = cut(c).info();
+
+			if (!child.is_winning && child.dte < min_losing_dte) {
+				min_losing_dte = child.dte;
+				quickest_win = c;
+			}
+
+			if (child.dte > max_dte) {
+				max_dte = child.dte;
+				longest_loss = c;
+			}
+		});
+
+		return (min_losing_dte < INT_MAX) ? quickest_win : longest_loss;
+	}
+
+	// Positions per group of info_batch, and child keys per group of probe_children
+	constexpr size_t QUERY_GROUP = 32;
+	constexpr size_t CHILD_GROUP = 128;
+
+	/**
+	 * Find which children of the chosen positions are losing, and their dtes, a group of positions at a time: first every
+	 * child's key is hashed and its bloom block fetched, then the candidates' map groups are fetched, and only then is
+	 * anything resolved. Calls f(i, cut, child_losing, dte) for each child of positions[i], in cut order
+	 */
+	template <typename F>
+	static void probe_children(const QueryTables* tables, std::span<const Position> positions, const std::vector<size_t>& chosen, F f) {
+		std::vector<uint64_t> keys;
+		std::vector<ProbeState> states;
+		std::vector<int> dtes;
+		std::vector<Cut> cuts;
+		// Squares of each child
+		std::vector<int> levels;
+
+		for (size_t next = 0; next < chosen.size(); ) {
+			size_t group_begin = next;
+			keys.clear();
+			states.clear();
+			dtes.clear();
+			cuts.clear();
+			levels.clear();
+
+			// Pass 1: hash every child of the group, answering what the oracle can
+			while (next < chosen.size() && (next == group_begin || keys.size() + positions[chosen[next]].square_count() <= CHILD_GROUP)) {
+				const Position& p = positions[chosen[next++]];
+
+				p.for_each_cut([&] (Cut c) {
+					Position cutted = p.cut(c);
+					oracle::Answer answer = oracle::query(cutted);
+
+					cuts.push_back(c);
+					dtes.push_back(answer.dte);
+					levels.push_back(cutted.square_count());
+
+					if (answer.known()) {
+						keys.push_back(0);
+						states.push_back(answer.is_winning ? ProbeState::MISS : ProbeState::LOSING);
+					} else {
+						keys.push_back(cutted.canonical_hash());
+						states.push_back(ProbeState::UNKNOWN);
+						query_losing_prefetch(tables, keys.back(), levels.back());
+					}
+				});
+			}
+
+			// Pass 2: test the bloom blocks and fetch the candidates' map groups
+			for (size_t k = 0; k < keys.size(); ++k) {
+				if (states[k] == ProbeState::UNKNOWN)
+					states[k] = query_losing_candidate(tables, keys[k]) ? ProbeState::CANDIDATE : ProbeState::MISS;
+			}
+
+			// Pass 3: resolve the candidates, then report each position's children
+			size_t k = 0;
+			for (size_t c = group_begin; c < next; ++c) {
+				size_t i = chosen[c];
+
+				for (int squares = positions[i].square_count(); squares > 0; --squares, ++k) {
+					if (states[k] == ProbeState::CANDIDATE)
+						states[k] = query_losing_resolve(tables, keys[k], levels[k], dtes[k]) ? ProbeState::LOSING : ProbeState::MISS;
+
+					f(i, cuts[k], states[k] == ProbeState::LOSING, dtes[k]);
+				}
 			}
 		}
+	}
+
+	void info_batch(std::span<const Position> positions, std::span<PositionInfo> out) {
+		if (out.size() < positions.size()) throw std::runtime_error(FILE_LINE"Output span is too short");
+
+		QueryTablesRef tables = pin_query_tables();
+		bool has_dte = query_has_dte(tables.get());
+
+		uint64_t keys[QUERY_GROUP];
+		ProbeState states[QUERY_GROUP];
+		// Positions that only their children can answer, as in Position::info
+		std::vector<size_t> scan;
+
+		for (size_t group = 0; group < positions.size(); group += QUERY_GROUP) {
+			size_t count = std::min(QUERY_GROUP, positions.size() - group);
+
+			// Pass 1: the oracle, or the position's key and bloom block
+			for (size_t k = 0; k < count; ++k) {
+				const Position& p = positions[group + k];
+				oracle::Answer answer = oracle::query(p);
+				states[k] = ProbeState::ANSWERED;
+
+				if (answer.known()) {
+					if (answer.dte >= 0)
+						out[group + k] = { .is_winning=answer.is_winning, .dte=answer.dte };
+					else
+						scan.push_back(group + k);
+
+					continue;
+				}
+
+				keys[k] = p.canonical_hash();
+				states[k] = ProbeState::UNKNOWN;
+				query_losing_prefetch(tables.get(), keys[k], p.square_count());
+			}
 
-		return hash;
+			// Pass 2: fetch the losing table's group for candidates, and the winning table's for the rest
+			for (size_t k = 0; k < count; ++k) {
+				if (states[k] != ProbeState::UNKNOWN) continue;
+
+				if (query_losing_candidate(tables.get(), keys[k])) {
+					states[k] = ProbeState::CANDIDATE;
+				} else {
+					states[k] = ProbeState::MISS;
+					if (!tables) winning_position_info.prefetch(keys[k]);
+				}
+			}
+
+			// Pass 3: resolve
+			for (size_t k = 0; k < count; ++k) {
+				if (states[k] == ProbeState::ANSWERED) continue;
+
+				int dte;
+				if (states[k] == ProbeState::CANDIDATE
+				    && query_losing_resolve(tables.get(), keys[k], positions[group + k].square_count(), dte)) {
+					out[group + k] = { .is_winning=false, .dte=has_dte ? dte : PositionInfo::UNKNOWN_DTE };
+					continue;
+				}
+
+				const WinningPositionInfo* winning_position = query_winning(tables.get(), keys[k], positions[group + k].square_count());
+				if (winning_position && winning_position->dte != WinningPositionInfo::NOT_COMPUTED)
+					out[group + k] = { .is_winning=true, .dte=winning_position->dte };
+				else
+					scan.push_back(group + k);
+			}
+		}
+
+		if (!has_dte) {
+			for (size_t i : scan) out[i] = { .is_winning=true, .dte=PositionInfo::UNKNOWN_DTE };
+			return;
+		}
+
+		// Winning positions, one more than their fastest losing child
+		for (size_t i : scan) out[i] = { .is_winning=true, .dte=INT_MAX };
+
+		probe_children(tables.get(), positions, scan, [&] (size_t i, Cut, bool child_losing, int dte) {
+			if (child_losing) out[i].dte = std::min(out[i].dte, dte + 1);
+		});
+	}
+
+	void winning_cuts_batch(std::span<const Position> positions, std::span<std::vector<Cut>> out) {
+		if (out.size() < positions.size()) throw std::runtime_error(FILE_LINE"Output span is too short");
+
+		std::vector<size_t> all(positions.size());
+		for (size_t i = 0; i < all.size(); ++i) {
+			all[i] = i;
+			out[i].clear();
+		}
+
+		QueryTablesRef tables = pin_query_tables();
+
+		probe_children(tables.get(), positions, all, [&] (size_t i, Cut c, bool child_losing, int) {
+			if (child_losing) out[i].push_back(c);
+		});
+	}
+
+	uint64_t hash_position(const Position &p) {
+		// It isn't the greatest hash function, but it works. The hash function *is* dependent on MAX_HEIGHT
+		return simd::active->hash(p.rows, p.height);
+	}
+
+	// Return the hash of the flipped position
+	uint64_t hash_flipped_position(const Position &p) {
+		return simd::active->hash_conjugate(p.rows, p.height);
 	}
 
 	Position::Position() {
@@ -396,6 +1297,14 @@ namespace Chomp {
 		}
 	}
 
+	Position& Position::operator=(const Position &p) {
+		height = p.height;
+		o = p.o;
+		std::copy(p.rows, p.rows + height, rows);
+
+		return *this;
+	}
+
 	Position Position::starting_rectangle(int width, int height) {
 		Position p;
 
@@ -587,11 +1496,18 @@ namespace Chomp {
 		return ss.str();
 	}
 
+	// The writers below only see the tables in memory, so a file written with levels spilled would miss them
+	static void check_nothing_spilled() {
+		if (!spilled_losing_position_info.empty() || !spilled_winning_position_info.empty())
+			throw std::runtime_error(FILE_LINE"Can't store tables with spilled levels; write a table_file during the solve instead");
+	}
+
 	void store_positions(const std::string& filename) {
 		store_positions(filename.c_str());
 	}
 
 	void store_positions(const char* filename) {
+		check_nothing_spilled();
 		store::write_map(losing_position_info, filename);
 	}
 
@@ -601,5 +1517,61 @@ namespace Chomp {
 
 	void load_positions(const char* filename) {
 		store::read_map(losing_position_info, filename);
+		rebuild_bloom_filter();
+	}
+
+	void store_positions_sharded(const char* prefix) {
+		check_nothing_spilled();
+		store::write_map_sharded(losing_position_info, prefix);
+	}
+
+	void load_positions_sharded(const char* prefix) {
+		store::read_map_sharded(losing_position_info, prefix);
+		rebuild_bloom_filter();
+	}
+
+	void store_snapshot(const std::string& filename) {
+		store_snapshot(filename.c_str());
+	}
+
+	void store_snapshot(const char* filename) {
+		check_nothing_spilled();
+		store::write_snapshot(losing_position_info, winning_position_info, bloom_losing_position_info, solved_region, filename);
+	}
+
+	void load_snapshot(const std::string& filename) {
+		load_snapshot(filename.c_str());
+	}
+
+	void load_snapshot(const char* filename) {
+		store::read_snapshot(losing_position_info, winning_position_info, bloom_losing_position_info, solved_region, filename);
+	}
+
+	void map_table(const char* filename, MapTableOptions options) {
+		auto tables = std::make_shared<QueryTables>();
+		tables->table = std::make_shared<const tablefile::Table>(filename, options);
+		tables->max_level = tables->table->get_header().max_squares;
+		tables->bound_width = tables->table->get_header().bound_width;
+		tables->bound_height = tables->table->get_header().bound_height;
+		tables->has_dte = tables->table->has_dte();
+
+		publish_query_tables(std::move(tables));
+	}
+
+	void unmap_table() {
+		query_tables_set.store(false, std::memory_order_release);
+		query_tables.store(nullptr);
+	}
+
+	int published_level() {
+		QueryTablesRef tables = pin_query_tables();
+		return tables ? tables->max_level : -1;
+	}
+
+	SolvedRegion answered_region() {
+		QueryTablesRef tables = pin_query_tables();
+		if (tables) return { tables->max_level, tables->bound_width, tables->bound_height, tables->has_dte };
+
+		return solved_region;
 	}
 }
\ No newline at end of file
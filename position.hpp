@@ -20,6 +20,7 @@
 #include <vector>
 #include <string>
 #include <initializer_list>
+#include <span>
 #include <iostream>
 #include <type_traits>
 #include <parallel_hashmap/phmap.h>
@@ -66,6 +67,36 @@ namespace Chomp {
 	{
 		bool compute_dte=false;
 		bool compute_winning_moves=false;
+		// Record the quickest winning cut of each winning position, the one to the losing child with the smallest dte, so
+		// that best_move is a single lookup. Needs compute_dte
+		bool compute_best_moves=false;
+		// Bytes of enumerated positions allowed to wait for the solver; enumeration stalls once it has filled this much
+		size_t batch_memory_budget=1ULL << 30;
+
+		// If set, the tables are checkpointed to this file after every checkpoint_interval completed levels
+		const char* checkpoint=nullptr;
+		int checkpoint_interval=1;
+		// Continue from the checkpoint file, if there is one, skipping the levels it has already completed
+		bool resume=false;
+
+		// If set, each completed level's losing positions are written to level_<n>.bin in this directory, in the background
+		const char* level_directory=nullptr;
+		// If set, the losing positions are also written, level by level in the background, to this v2 table file
+		const char* table_file=nullptr;
+
+		// If set, every losing position, including those the oracle answers and the tables leave out, is also written to this
+		// catalog file (see catalog.hpp), so that they can be listed later
+		const char* catalog_file=nullptr;
+
+		// If set, each completed level is published to queries once sorted (see published_level), so that they can run while
+		// the solver works on later levels. The published levels are a sorted copy of the losing table
+		bool publish_levels=false;
+
+		// If nonzero, once the tables take more than this many bytes, the largest completed levels are moved out of them into
+		// sorted files in spill_directory, which are mapped and searched in place. The bloom filter always stays in memory.
+		// store_positions and store_snapshot refuse tables with spilled levels, so write a table_file alongside
+		size_t table_memory_budget=0;
+		const char* spill_directory=nullptr;
 	};
 
 	// Orientation of the position, relative to the canonical reflection. Example:
@@ -74,7 +105,7 @@ namespace Chomp {
 	//     ###               ###
 	// not canonical      canonical
 	// Symmetrical positions are always canonical
-	enum class Orientation
+	enum class Orientation : uint8_t
 	{
 		CANONICAL,
 		SYMMETRICAL,
@@ -86,11 +117,30 @@ namespace Chomp {
 
   struct LosingPositionInfo {
   	int dte;
+  	// Number of squares, or 0 if not known (loaded from a legacy file); fits in the slot's padding
+  	int level = 0;
   };
 
 	using map_type = phmap::parallel_flat_hash_map<uint64_t, LosingPositionInfo>;
 
+	// Side table entry for a winning position, only filled in when computing dte or winning moves
+	struct WinningPositionInfo {
+		static constexpr uint16_t NOT_COMPUTED = UINT16_MAX;
+
+		uint16_t dte = NOT_COMPUTED;
+		uint16_t winning_cuts = NOT_COMPUTED;
+		uint16_t level = 0;
+		// Index, in for_each_cut order on the canonical orientation, of the cut to the losing child with the smallest dte
+		// (see HashPositionOptions::compute_best_moves, which needs compute_dte). Fits in what was padding, so the tables don't grow
+		uint16_t best_cut = NOT_COMPUTED;
+	};
+
+	using winning_map_type = phmap::parallel_flat_hash_map<uint64_t, WinningPositionInfo>;
+
 	struct PositionInfo {
+		// dte of positions looked up in tables solved without compute_dte (see answered_region)
+		static constexpr int UNKNOWN_DTE = -1;
+
 		bool is_winning;
 		int dte; // distance to game end, assuming optimal play
 	};
@@ -113,6 +163,7 @@ namespace Chomp {
 		Position();
 		Position(const std::initializer_list<int>&);
 		Position(const Position&); // copy constructor
+		Position& operator=(const Position&); // copies only the rows in use, like the copy constructor
 
 		void make_empty();
 
@@ -138,13 +189,22 @@ namespace Chomp {
 
 		template <typename Lambda>
 		void for_each_cut(Lambda) const;
+		// The index-th cut in for_each_cut order, for 0 <= index < square_count()
+		Cut nth_cut(int index) const;
 
 		static Position starting_rectangle(int width, int height);
 		static Position empty_position();
 
 		std::vector<Cut> winning_cuts() const;
 		int num_winning_cuts() const;
-
+		// Quickest winning cut from a winning position, the cut delaying the loss longest from a losing one, or (-1, -1)
+		// from the empty position. Throws if the tables have no dtes
+		Cut best_move() const;
+		// The quickest winning cut the solver recorded for this position (see HashPositionOptions::compute_best_moves, which
+		// is only accepted with compute_dte), or (-1, -1) if it recorded none
+		Cut recorded_best_move() const;
+
+		// dte is UNKNOWN_DTE, unless the oracle knows it, if the tables were solved without compute_dte
 		PositionInfo info() const;
 		Orientation is_canonical();
 
@@ -276,13 +336,88 @@ namespace Chomp {
 		}
 	}
 
+	/**
+	 * Position::info of each position, with the lookups of a group of positions interleaved so that their cache misses
+	 * overlap rather than each waiting on the last. Positions the tables don't answer have their children probed the same
+	 * way, a group at a time
+	 * @param out At least as long as positions
+	 */
+	void info_batch(std::span<const Position> positions, std::span<PositionInfo> out);
+
+	// Position::winning_cuts of each position, with the children's lookups interleaved as in info_batch
+	void winning_cuts_batch(std::span<const Position> positions, std::span<std::vector<Cut>> out);
+
+	// Levels and bounds a table has already been solved for
+	struct SolvedRegion {
+		int max_squares = 0;
+		int bound_width = -1;
+		int bound_height = -1;
+		// Whether it was solved with compute_dte; otherwise queries give UNKNOWN_DTE, and it can't be extended with dtes
+		bool has_dte = false;
+
+		bool contains(int n, int width, int height) const;
+	};
+
 	void hash_positions(int max_squares, int bound_width=-1, int bound_height=-1, HashPositionOptions={});
 
+	/**
+	 * Solve the positions within max_squares and the bounds that are not already in the tables, which hold the positions
+	 * of the solved region. Solved levels are revisited only for their newly admitted shapes, so growing a table costs
+	 * only the new positions. The level counts printed cover just the new positions
+	 * @param solved Region the loaded tables were solved for; its bounds must be within bound_width and bound_height
+	 */
+	void extend_positions(SolvedRegion solved, int max_squares, int bound_width=-1, int bound_height=-1, HashPositionOptions={});
+
 	void store_positions(const std::string& filename);
 	void store_positions(const char* filename);
 
 	void load_positions(const std::string& filename);
 	void load_positions(const char* filename);
+
+	// One file per submap, <prefix>.<i>, written and read in parallel
+	void store_positions_sharded(const char* prefix);
+	void load_positions_sharded(const char* prefix);
+
+	// Both tables and the bloom filter, as their raw internal arrays, so loading is a straight read with no rehashing, and the
+	// region they were solved for
+	void store_snapshot(const std::string& filename);
+	void store_snapshot(const char* filename);
+
+	void load_snapshot(const std::string& filename);
+	void load_snapshot(const char* filename);
+
+	struct MapTableOptions {
+		// Fault the whole file in while mapping it, so that no query waits on the disk
+		bool populate = false;
+		// Ask for transparent huge pages, for fewer TLB misses over a large table. Only some kernels and filesystems back file
+		// mappings with them; elsewhere this does nothing
+		bool hugepages = false;
+	};
+
+	/**
+	 * Answer the losing-position lookups of queries (info, winning_cuts, num_winning_cuts, best_move and their batched forms)
+	 * from a v2 table file instead of the losing table. The file is mapped read-only and shared, so every process mapping
+	 * it shares the same page cache pages. The solver still uses the tables in memory.
+	 *
+	 * Queries see either the old or the new table, never a mix. Mapping another file while queries run swaps it in for the
+	 * queries that start afterwards; the old one is unmapped when the last query reading it finishes
+	 */
+	void map_table(const char* filename, MapTableOptions={});
+	// Queries go back to reading the tables in memory, which must no longer be changing
+	void unmap_table();
+
+	/**
+	 * Highest level that queries can answer while they read published levels or a mapped table, or -1 if they read the
+	 * tables in memory. During a solve with HashPositionOptions::publish_levels, queries of larger positions are wrong
+	 */
+	int published_level();
+
+	/**
+	 * Positions that queries answer from the tables: the published levels or mapped table, if any, and otherwise what the
+	 * tables in memory were solved for or loaded from a snapshot. Outside it, answers are wrong once a position's children
+	 * aren't in the tables either
+	 */
+	SolvedRegion answered_region();
 }
 
 #endif //CHOMP_POSITION_H
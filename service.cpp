@@ -0,0 +1,337 @@
+#include <service.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Chomp {
+	namespace service {
+		int LatencyHistogram::bucket(uint64_t ns) {
+			if (ns < SUB_BUCKETS) return (int) ns;
+
+			int exponent = 63 - __builtin_clzll(ns);
+			int sub = (int) (ns >> (exponent - 3)) & (SUB_BUCKETS - 1);
+
+			return (exponent - 2) * SUB_BUCKETS + sub;
+		}
+
+		uint64_t LatencyHistogram::bucket_floor(int b) {
+			if (b < SUB_BUCKETS) return b;
+
+			int exponent = b / SUB_BUCKETS + 2;
+			return (uint64_t) (SUB_BUCKETS + b % SUB_BUCKETS) << (exponent - 3);
+		}
+
+		void LatencyHistogram::add(uint64_t ns) {
+			buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+			total.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		uint64_t LatencyHistogram::percentile(double q) const {
+			uint64_t rank = (uint64_t) std::ceil(q * count());
+			uint64_t seen = 0;
+
+			for (int b = 0; b < 64 * SUB_BUCKETS; ++b) {
+				seen += buckets[b].load(std::memory_order_relaxed);
+				if (seen >= rank && seen > 0) return bucket_floor(b);
+			}
+
+			return 0;
+		}
+
+		// Bounds-checked reads from a request payload
+		struct Reader {
+			const uint8_t* in;
+			const uint8_t* end;
+
+			template <typename T>
+			T get() {
+				if ((size_t) (end - in) < sizeof(T)) throw std::runtime_error("Truncated request");
+
+				T value;
+				memcpy(&value, in, sizeof(T));
+				in += sizeof(T);
+
+				return value;
+			}
+		};
+
+		template <typename T>
+		static void put(std::vector<uint8_t>& out, T value) {
+			size_t at = out.size();
+			out.resize(at + sizeof(T));
+			memcpy(out.data() + at, &value, sizeof(T));
+		}
+
+		static Position read_position(Reader& reader) {
+			int height = reader.get<uint8_t>();
+			if (height > MAX_HEIGHT) throw std::runtime_error("Position too tall");
+
+			Position p = Position::empty_position();
+			for (int i = 0; i < height; ++i) p.rows[i] = reader.get<uint16_t>();
+
+			p.height = height;
+			if (!p.is_legal() || (height > 0 && p.rows[height - 1] == 0))
+				throw std::runtime_error("Rows must be positive and non-increasing");
+
+			// Children of positions outside it aren't in the tables either, so they would all be taken for winning
+			if (!answered_region().contains(p.square_count(), p.get_width(), p.get_height()))
+				throw std::runtime_error("Position outside the solved tables");
+
+			return p;
+		}
+
+		void Server::handle(const uint8_t* request, size_t size, std::vector<uint8_t>& response) {
+			auto begin = std::chrono::steady_clock::now();
+			response.clear();
+
+			Reader reader { request, request + size };
+			Op op = Op::STATS;
+
+			try {
+				op = (Op) reader.get<uint8_t>();
+				uint32_t count = reader.get<uint32_t>();
+
+				if (op < Op::INFO || op > Op::STATS) throw std::runtime_error("Unknown op");
+
+				put(response, Status::OK);
+
+				if (op == Op::STATS) {
+					put<uint32_t>(response, NUM_OPS - 1);
+
+					for (int i = 1; i < NUM_OPS; ++i) {
+						put<uint8_t>(response, i);
+						put<uint64_t>(response, latency[i].count());
+						put<uint64_t>(response, latency[i].percentile(0.5));
+						put<uint64_t>(response, latency[i].percentile(0.99));
+					}
+				} else {
+					// Each position costs at least its height byte, so count can't make this huge
+					if (count > (size_t) (reader.end - reader.in)) throw std::runtime_error("Truncated request");
+
+					std::vector<Position> positions;
+					positions.reserve(count);
+					for (uint32_t i = 0; i < count; ++i) positions.push_back(read_position(reader));
+
+					put<uint32_t>(response, count);
+
+					switch (op) {
+						case Op::INFO: {
+							std::vector<PositionInfo> infos(count);
+							info_batch(positions, infos);
+
+							for (const PositionInfo& info : infos) {
+								put<uint8_t>(response, info.is_winning);
+								put<int32_t>(response, info.dte);
+							}
+							break;
+						}
+						case Op::WINNING_CUTS: {
+							std::vector<std::vector<Cut>> cuts(count);
+							winning_cuts_batch(positions, cuts);
+
+							for (const std::vector<Cut>& position_cuts : cuts) {
+								put<uint16_t>(response, position_cuts.size());
+
+								for (Cut c : position_cuts) {
+									put<uint16_t>(response, c.first);
+									put<uint16_t>(response, c.second);
+								}
+							}
+							break;
+						}
+						case Op::NUM_WINNING_CUTS:
+							for (const Position& p : positions) put<int32_t>(response, p.num_winning_cuts());
+							break;
+						default:
+							for (const Position& p : positions) {
+								Cut c = p.best_move();
+								put<int16_t>(response, c.first);
+								put<int16_t>(response, c.second);
+							}
+					}
+				}
+
+				if (reader.in != reader.end) throw std::runtime_error("Trailing bytes in request");
+			} catch (const std::exception& e) {
+				response.clear();
+				put(response, Status::ERROR);
+				response.insert(response.end(), e.what(), e.what() + strlen(e.what()));
+
+				return;
+			}
+
+			auto end = std::chrono::steady_clock::now();
+			latency[(int) op].add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+		}
+
+		// Read or write exactly size bytes, retrying short transfers. False at end of input or on error
+		static bool read_fully(int fd, void* data, size_t size) {
+			uint8_t* at = (uint8_t*) data;
+
+			while (size > 0) {
+				ssize_t got = read(fd, at, size);
+				if (got < 0 && errno == EINTR) continue;
+				if (got <= 0) return false;
+
+				at += got;
+				size -= got;
+			}
+
+			return true;
+		}
+
+		static bool write_fully(int fd, const void* data, size_t size) {
+			const uint8_t* at = (const uint8_t*) data;
+
+			while (size > 0) {
+				ssize_t put = write(fd, at, size);
+				if (put < 0 && errno == EINTR) continue;
+				if (put <= 0) return false;
+
+				at += put;
+				size -= put;
+			}
+
+			return true;
+		}
+
+		void Server::serve_stream(int in, int out) {
+			// Reused across frames, so a connection allocates only as its largest frame grows
+			std::vector<uint8_t> request, response;
+
+			while (true) {
+				uint32_t size;
+				if (!read_fully(in, &size, sizeof(size)) || size > MAX_FRAME_SIZE) return;
+
+				request.resize(size);
+				if (!read_fully(in, request.data(), size)) return;
+
+				handle(request.data(), size, response);
+
+				uint32_t response_size = response.size();
+				if (!write_fully(out, &response_size, sizeof(response_size))
+				    || !write_fully(out, response.data(), response.size())) return;
+			}
+		}
+
+		void Server::serve_socket(const char* path) {
+			sockaddr_un address = {};
+			address.sun_family = AF_UNIX;
+
+			if (strlen(path) >= sizeof(address.sun_path)) throw std::runtime_error(FILE_LINE"Socket path too long");
+			strcpy(address.sun_path, path);
+
+			// A client hanging up mid-response should only end its connection
+			std::signal(SIGPIPE, SIG_IGN);
+
+			int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (listener < 0) throw std::runtime_error(FILE_LINE"Failed to create socket");
+
+			unlink(path);
+			if (bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+				close(listener);
+				throw std::runtime_error(FILE_LINE"Failed to listen on socket");
+			}
+
+			while (true) {
+				int connection = accept(listener, nullptr, nullptr);
+
+				if (connection < 0) {
+					if (errno == EINTR || errno == ECONNABORTED) continue;
+
+					close(listener);
+					throw std::runtime_error(FILE_LINE"Failed to accept connection");
+				}
+
+				std::thread([this, connection] {
+					serve_stream(connection, connection);
+					close(connection);
+				}).detach();
+			}
+		}
+
+		void reload_on_sighup(const char* filename, MapTableOptions options) {
+			sigset_t signals;
+			sigemptyset(&signals);
+			sigaddset(&signals, SIGHUP);
+
+			// Threads inherit the mask, so only the reloader takes the signal
+			pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+			std::thread([filename, options, signals] {
+				int signal;
+
+				while (sigwait(&signals, &signal) == 0) {
+					try {
+						map_table(filename, options);
+						std::fprintf(stderr, "Reloaded %s\n", filename);
+					} catch (const std::exception& e) {
+						// Keep serving the old table
+						std::fprintf(stderr, "Failed to reload %s: %s\n", filename, e.what());
+					}
+				}
+			}).detach();
+		}
+
+		void benchmark(const std::vector<Position>& positions, FILE* f) {
+			// Best of a few runs, each path warming the tables for the other's next run
+			const int RUNS = 3;
+
+			auto rate = [&] (auto run) {
+				double best = 0;
+
+				for (int r = 0; r < RUNS; ++r) {
+					auto begin = std::chrono::steady_clock::now();
+					run();
+					double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+					if (seconds > 0) best = std::max(best, positions.size() / seconds);
+				}
+
+				return best;
+			};
+
+			std::vector<PositionInfo> single(positions.size()), batched(positions.size());
+
+			double info_single = rate([&] { for (size_t i = 0; i < positions.size(); ++i) single[i] = positions[i].info(); });
+			double info_batched = rate([&] { info_batch(positions, batched); });
+
+			for (size_t i = 0; i < positions.size(); ++i) {
+				if (single[i].is_winning != batched[i].is_winning || single[i].dte != batched[i].dte)
+					throw std::runtime_error(FILE_LINE"info_batch disagrees with info");
+			}
+
+			std::vector<std::vector<Cut>> single_cuts(positions.size()), batched_cuts(positions.size());
+
+			double cuts_single = rate([&] { for (size_t i = 0; i < positions.size(); ++i) single_cuts[i] = positions[i].winning_cuts(); });
+			double cuts_batched = rate([&] { winning_cuts_batch(positions, batched_cuts); });
+
+			if (single_cuts != batched_cuts) throw std::runtime_error(FILE_LINE"winning_cuts_batch disagrees with winning_cuts");
+
+			std::fprintf(f, "info: %.0f positions/s single, %.0f batched (%.2fx)\n", info_single, info_batched,
+			             info_batched / info_single);
+			std::fprintf(f, "winning_cuts: %.0f positions/s single, %.0f batched (%.2fx)\n", cuts_single, cuts_batched,
+			             cuts_batched / cuts_single);
+		}
+
+		void Server::print_latency(FILE* f) const {
+			static const char* names[NUM_OPS] = { "", "info", "winning_cuts", "num_winning_cuts", "best_move", "stats" };
+
+			for (int i = 1; i < NUM_OPS; ++i) {
+				std::fprintf(f, "%s: %llu requests, p50 %llu ns, p99 %llu ns\n", names[i],
+				             (unsigned long long) latency[i].count(), (unsigned long long) latency[i].percentile(0.5),
+				             (unsigned long long) latency[i].percentile(0.99));
+			}
+		}
+	}
+}
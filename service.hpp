@@ -0,0 +1,110 @@
+#ifndef CHOMP_SERVICE_H
+#define CHOMP_SERVICE_H
+
+#include <position.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace Chomp {
+	namespace service {
+		/*
+		 * Query protocol, little endian. Each message is a frame: its payload size (uint32_t), then the payload.
+		 *
+		 *   Request:  op (uint8_t), count (uint32_t), then count positions, each its height (uint8_t) and its rows from
+		 *             the bottom up (uint16_t[height])
+		 *   Response: status (uint8_t). OK is followed by count (uint32_t) and one result per position, in order:
+		 *               INFO              is_winning (uint8_t), dte (int32_t), -1 if the tables have no dtes
+		 *               WINNING_CUTS      cuts (uint16_t), then each cut's row and column (uint16_t, uint16_t)
+		 *               NUM_WINNING_CUTS  cuts (int32_t)
+		 *               BEST_MOVE         row and column (int16_t, int16_t), both -1 for the empty position; an
+		 *                                 error if the tables have no dtes
+		 *             STATS takes no positions and answers, for each op, op (uint8_t), requests (uint64_t) and the p50
+		 *             and p99 latencies in nanoseconds (uint64_t, uint64_t), preceded by the number of ops (uint32_t).
+		 *             ERROR is followed by a message, the rest of the payload
+		 */
+		enum class Op : uint8_t
+		{
+			INFO = 1,
+			WINNING_CUTS = 2,
+			NUM_WINNING_CUTS = 3,
+			BEST_MOVE = 4,
+			STATS = 5
+		};
+
+		constexpr int NUM_OPS = 6; // indexed by Op, 0 unused
+
+		enum class Status : uint8_t
+		{
+			OK = 0,
+			ERROR = 1
+		};
+
+		// Frames larger than this are refused, and the connection closed
+		constexpr uint32_t MAX_FRAME_SIZE = 1 << 26;
+
+		/**
+		 * Latency distribution that any number of threads can add to. Buckets are eight per power of two of nanoseconds,
+		 * so a percentile is within 12.5% of the true value
+		 */
+		class LatencyHistogram {
+		private:
+			static constexpr int SUB_BUCKETS = 8;
+			std::atomic<uint64_t> buckets[64 * SUB_BUCKETS] = {};
+			std::atomic<uint64_t> total{0};
+
+			static int bucket(uint64_t ns);
+			// Smallest latency that falls in bucket b
+			static uint64_t bucket_floor(int b);
+		public:
+			void add(uint64_t ns);
+
+			uint64_t count() const { return total.load(std::memory_order_relaxed); }
+			// Latency below which a fraction q of the requests fell, rounded down to its bucket
+			uint64_t percentile(double q) const;
+		};
+
+		/**
+		 * Time Position::info and winning_cuts one position at a time against info_batch and winning_cuts_batch over the
+		 * same positions, check that they agree, and print the throughput of each
+		 */
+		void benchmark(const std::vector<Position>& positions, FILE* f);
+
+		/**
+		 * Map filename again whenever the process gets SIGHUP, swapping it in for new queries while those already running
+		 * finish on the old table (see map_table). Call it before starting any other thread, so that they all leave SIGHUP
+		 * to its thread. Only table files can be swapped: a snapshot is loaded into the tables in memory, which queries read
+		 * without pinning, so replacing it takes a restart
+		 */
+		void reload_on_sighup(const char* filename, MapTableOptions options);
+
+		/**
+		 * Answers query frames from the tables, which must be loaded before serving, and either not change while serving or
+		 * be published (see map_table and HashPositionOptions::publish_levels). Positions outside answered_region are
+		 * refused. Every connection has its own thread. Batches of info and winning_cuts queries are answered with
+		 * info_batch and winning_cuts_batch
+		 */
+		class Server {
+		private:
+			LatencyHistogram latency[NUM_OPS];
+		public:
+			/**
+			 * Answer one request payload
+			 * @param response Replaced with the response payload
+			 */
+			void handle(const uint8_t* request, size_t size, std::vector<uint8_t>& response);
+
+			// Answer frames from in on out until in is closed, or a frame is malformed
+			void serve_stream(int in, int out);
+
+			// Listen on a Unix socket at path, replacing any file there, and serve each connection on its own thread. Never returns
+			void serve_socket(const char* path);
+
+			// p50 and p99 of each op, one line each
+			void print_latency(FILE* f) const;
+		};
+	}
+}
+
+#endif //CHOMP_SERVICE_H
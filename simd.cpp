@@ -0,0 +1,633 @@
+#include <simd.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHOMP_X86 1
+#else
+#define CHOMP_X86 0
+#endif
+
+namespace Chomp {
+	namespace simd {
+		constexpr uint64_t HASH_MULTIPLIER = 179424673L;
+
+		// The hash of a position is sum(rows[i] * HASH_MULTIPLIER^(height - i)), so the vector kernels multiply by
+		// precomputed powers instead of running Horner's rule. The conjugate's hash telescopes to
+		// height * S(width) - sum(S(width - rows[i])), where S(m) is the sum of the first m powers.
+		struct Tables {
+			// powers[j] = HASH_MULTIPLIER^(MAX_HEIGHT + 1 - j), so that the powers for consecutive rows are contiguous.
+			// Padded with zeros for the vector tails
+			uint64_t powers[MAX_HEIGHT + 1 + 16];
+			uint64_t prefix_sums[MAX_CONJUGATE_WIDTH + 1];
+
+			Tables() {
+				uint64_t power = 1;
+				for (int j = MAX_HEIGHT + 1; j >= 0; --j) {
+					if (j <= MAX_HEIGHT) powers[j] = power;
+					power *= HASH_MULTIPLIER;
+				}
+				std::fill(powers + MAX_HEIGHT + 1, powers + MAX_HEIGHT + 1 + 16, 0);
+
+				power = HASH_MULTIPLIER;
+				prefix_sums[0] = 0;
+				for (int m = 1; m <= MAX_CONJUGATE_WIDTH; ++m) {
+					prefix_sums[m] = prefix_sums[m - 1] + power;
+					power *= HASH_MULTIPLIER;
+				}
+			}
+		};
+
+		static const Tables tables;
+
+		// Scalar kernels, the reference for the others
+
+		static int cut_scalar(const int* rows, int height, int row, int col, int* dst) {
+			for (int i = 0; i < row; ++i) {
+				dst[i] = rows[i];
+			}
+
+			if (col == 0) return row;
+
+			for (int i = row; i < height; ++i) {
+				dst[i] = std::min(col, rows[i]);
+			}
+
+			return height;
+		}
+
+		static int conjugate_scalar(const int* rows, int height, int* dst) {
+			// Note that if rows[0] >= MAX_HEIGHT it may be chopped off
+			int col = 0;
+
+			for (int i = height - 1; i >= 0; --i) {
+				int row = rows[i];
+
+				while (row > col) {
+					dst[col] = i + 1;
+					col++;
+
+					if (col == MAX_HEIGHT) return col;
+				}
+			}
+
+			return col;
+		}
+
+		static Orientation orientation_scalar(const int* rows, int height) {
+			using O = Orientation;
+
+			// Easy criteria. The empty position comes first, since it has no rows[0]
+			if (height == 0) return O::SYMMETRICAL;
+			if (rows[0] > height) return O::CANONICAL;
+			if (rows[0] < height) return O::NOT_CANONICAL;
+
+			// We calculate the number of tiles in each column and compare sequentially to rows[col]
+			int col = 1;
+			for (int i = height - 1; i >= 0; --i) {
+				int r = rows[i];
+				while (r > col) {
+					// i + 1 is the number of tiles in column col
+					if (i + 1 > rows[col])
+						return O::NOT_CANONICAL;
+					else if (i + 1 < rows[col])
+						return O::CANONICAL;
+
+					col++;
+				}
+			}
+
+			return O::SYMMETRICAL;
+		}
+
+		static uint64_t hash_scalar(const int* rows, int height) {
+			// It isn't the greatest hash function, but it works. The hash function *is* dependent on MAX_HEIGHT
+			uint64_t hash = 0;
+			for (int i = 0; i < height; ++i) {
+				hash += rows[i];
+				hash *= HASH_MULTIPLIER;
+			}
+
+			return hash;
+		}
+
+		static uint64_t hash_conjugate_scalar(const int* rows, int height) {
+			int col = 0;
+			uint64_t hash = 0;
+
+			for (int i = height - 1; i >= 0; --i) {
+				int row = rows[i];
+
+				while (row > col) {
+					hash += i + 1;
+					hash *= HASH_MULTIPLIER;
+					col++;
+				}
+			}
+
+			return hash;
+		}
+
+		// Whether a child of a lane group must be left to the caller (see LaneHashes)
+		static inline bool is_special_child(int width, int second, int top, int height) {
+			return height <= 2 || width <= 2 || second == 1 || top == width || width == height || width > MAX_CONJUGATE_WIDTH;
+		}
+
+		static void lane_cut_hashes_scalar(const PositionLanes& lanes, int row, int col, LaneHashes& out) {
+			out.valid = out.special = 0;
+
+			for (int lane = 0; lane < lanes.count; ++lane) {
+				if (lanes.rows[row][lane] <= col) continue;
+
+				out.valid |= 1u << lane;
+
+				int rows[MAX_HEIGHT], child[MAX_HEIGHT];
+				for (int i = 0; i < lanes.height; ++i) rows[i] = lanes.rows[i][lane];
+
+				int child_height = cut_scalar(rows, lanes.height, row, col, child);
+
+				if (child_height <= 2 || is_special_child(child[0], child[1], child[child_height - 1], child_height)) {
+					out.special |= 1u << lane;
+					continue;
+				}
+
+				out.hashes[lane] = (child[0] > child_height) ? hash_scalar(child, child_height) : hash_conjugate_scalar(child, child_height);
+			}
+		}
+
+		static const Kernels scalar_kernels = {
+			"scalar", cut_scalar, conjugate_scalar, orientation_scalar, hash_scalar, hash_conjugate_scalar,
+			lane_cut_hashes_scalar
+		};
+
+#if CHOMP_X86
+		// AVX2 kernels: 8 rows per vector, or 4 for the 64-bit hash arithmetic
+
+		#define CHOMP_AVX2 __attribute__((target("avx2")))
+
+		CHOMP_AVX2 static inline __m256i iota8() {
+			return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		}
+
+		// Lanes i, i + 1, ... that are less than end
+		CHOMP_AVX2 static inline __m256i lanes_below8(int i, int end) {
+			return _mm256_cmpgt_epi32(_mm256_set1_epi32(end), _mm256_add_epi32(_mm256_set1_epi32(i), iota8()));
+		}
+
+		CHOMP_AVX2 static inline __m128i lanes_below4(int i, int end) {
+			return _mm_cmpgt_epi32(_mm_set1_epi32(end), _mm_add_epi32(_mm_set1_epi32(i), _mm_setr_epi32(0, 1, 2, 3)));
+		}
+
+		CHOMP_AVX2 static inline uint64_t sum_lanes4(__m256i v) {
+			__m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+			return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+		}
+
+		// Number of tiles in columns j, ..., j + 7. Rows are nonincreasing, so only the first few rows can reach column j
+		CHOMP_AVX2 static inline __m256i column_heights8(const int* rows, int height, int j) {
+			__m256i cols = _mm256_add_epi32(_mm256_set1_epi32(j), iota8());
+			__m256i counts = _mm256_setzero_si256();
+
+			for (int i = 0; i < height && rows[i] > j; ++i) {
+				counts = _mm256_sub_epi32(counts, _mm256_cmpgt_epi32(_mm256_set1_epi32(rows[i]), cols));
+			}
+
+			return counts;
+		}
+
+		CHOMP_AVX2 static int cut_avx2(const int* rows, int height, int row, int col, int* dst) {
+			int end = (col == 0) ? row : height;
+			__m256i row_v = _mm256_set1_epi32(row);
+			__m256i col_v = _mm256_set1_epi32(col);
+			__m256i no_limit = _mm256_set1_epi32(INT_MAX);
+
+			for (int i = 0; i < end; i += 8) {
+				__m256i valid = lanes_below8(i, end);
+				__m256i idx = _mm256_add_epi32(_mm256_set1_epi32(i), iota8());
+
+				// Rows at or above the cut are limited to col
+				__m256i limit = _mm256_blendv_epi8(col_v, no_limit, _mm256_cmpgt_epi32(row_v, idx));
+				__m256i r = _mm256_min_epi32(_mm256_maskload_epi32(rows + i, valid), limit);
+
+				_mm256_maskstore_epi32(dst + i, valid, r);
+			}
+
+			return end;
+		}
+
+		CHOMP_AVX2 static int conjugate_avx2(const int* rows, int height, int* dst) {
+			int width = (height > 0) ? std::min(rows[0], MAX_HEIGHT) : 0;
+
+			for (int j = 0; j < width; j += 8) {
+				_mm256_maskstore_epi32(dst + j, lanes_below8(j, width), column_heights8(rows, height, j));
+			}
+
+			return width;
+		}
+
+		CHOMP_AVX2 static Orientation orientation_avx2(const int* rows, int height) {
+			using O = Orientation;
+
+			if (height == 0) return O::SYMMETRICAL;
+			if (rows[0] > height) return O::CANONICAL;
+			if (rows[0] < height) return O::NOT_CANONICAL;
+
+			// Compare columns 1, 2, ... to rows 1, 2, ..., which all exist since rows[0] == height
+			for (int j = 1; j < height; j += 8) {
+				__m256i valid = lanes_below8(j, height);
+				__m256i counts = column_heights8(rows, height, j);
+				__m256i r = _mm256_maskload_epi32(rows + j, valid);
+
+				__m256i differ = _mm256_andnot_si256(_mm256_cmpeq_epi32(counts, r), valid);
+				int mask = _mm256_movemask_ps(_mm256_castsi256_ps(differ));
+
+				if (mask) {
+					int lane = __builtin_ctz(mask);
+					int counts_arr[8], r_arr[8];
+
+					_mm256_storeu_si256((__m256i*)counts_arr, counts);
+					_mm256_storeu_si256((__m256i*)r_arr, r);
+
+					return (counts_arr[lane] > r_arr[lane]) ? O::NOT_CANONICAL : O::CANONICAL;
+				}
+			}
+
+			return O::SYMMETRICAL;
+		}
+
+		CHOMP_AVX2 static uint64_t hash_avx2(const int* rows, int height) {
+			const uint64_t* powers = tables.powers + (MAX_HEIGHT + 1 - height);
+			__m256i acc = _mm256_setzero_si256();
+
+			for (int i = 0; i < height; i += 4) {
+				__m256i r = _mm256_cvtepu32_epi64(_mm_maskload_epi32(rows + i, lanes_below4(i, height)));
+				__m256i p = _mm256_loadu_si256((const __m256i*)(powers + i));
+
+				// 32x64-bit multiply from two 32x32-bit multiplies
+				__m256i lo = _mm256_mul_epu32(r, p);
+				__m256i hi = _mm256_mul_epu32(r, _mm256_srli_epi64(p, 32));
+
+				acc = _mm256_add_epi64(acc, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+			}
+
+			return sum_lanes4(acc);
+		}
+
+		CHOMP_AVX2 static uint64_t hash_conjugate_avx2(const int* rows, int height) {
+			if (height == 0) return 0;
+
+			int width = rows[0];
+			if (width > MAX_CONJUGATE_WIDTH) return hash_conjugate_scalar(rows, height);
+
+			const long long* prefix_sums = (const long long*)tables.prefix_sums;
+			__m128i width_v = _mm_set1_epi32(width);
+			__m256i acc = _mm256_setzero_si256();
+
+			for (int i = 0; i < height; i += 4) {
+				__m128i valid = lanes_below4(i, height);
+				__m128i idx = _mm_sub_epi32(width_v, _mm_maskload_epi32(rows + i, valid));
+
+				acc = _mm256_add_epi64(acc, _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), prefix_sums, idx,
+				                                                        _mm256_cvtepi32_epi64(valid), 8));
+			}
+
+			return (uint64_t)height * tables.prefix_sums[width] - sum_lanes4(acc);
+		}
+
+		// Row i of the children of lanes base, ..., base + 7 for a cut at (row, col)
+		CHOMP_AVX2 static inline __m256i lane_child_row8(const PositionLanes& lanes, int i, int base, int row, __m256i col_v) {
+			__m256i r = _mm256_load_si256((const __m256i*)(lanes.rows[i] + base));
+			return (i < row) ? r : _mm256_min_epi32(r, col_v);
+		}
+
+		// 64-bit lanes of a * b, for b < 2^32
+		CHOMP_AVX2 static inline __m256i mul64_u32(__m256i a, __m256i b) {
+			__m256i lo = _mm256_mul_epu32(a, b);
+			__m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+
+			return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+		}
+
+		CHOMP_AVX2 static void lane_cut_hashes_avx2(const PositionLanes& lanes, int row, int col, LaneHashes& out) {
+			int child_height = (col == 0) ? row : lanes.height;
+			const long long* prefix_sums = (const long long*)tables.prefix_sums;
+			__m256i col_v = _mm256_set1_epi32(col);
+			__m256i height_v = _mm256_set1_epi32(child_height);
+
+			out.valid = out.special = 0;
+
+			for (int base = 0; base < lanes.count; base += 8) {
+				__m256i cut_row = _mm256_load_si256((const __m256i*)(lanes.rows[row] + base));
+				__m256i valid = _mm256_and_si256(lanes_below8(base, lanes.count), _mm256_cmpgt_epi32(cut_row, col_v));
+				uint32_t valid_bits = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+
+				out.valid |= valid_bits << base;
+				if (!valid_bits) continue;
+
+				if (child_height <= 2) {
+					out.special |= valid_bits << base;
+					continue;
+				}
+
+				__m256i width = lane_child_row8(lanes, 0, base, row, col_v);
+				__m256i special = _mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(3), width),
+					                _mm256_cmpeq_epi32(lane_child_row8(lanes, 1, base, row, col_v), _mm256_set1_epi32(1))),
+					_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(lane_child_row8(lanes, child_height - 1, base, row, col_v), width),
+					                                _mm256_cmpeq_epi32(width, height_v)),
+					                _mm256_cmpgt_epi32(width, _mm256_set1_epi32(MAX_CONJUGATE_WIDTH))));
+				special = _mm256_and_si256(special, valid);
+
+				__m256i direct = _mm256_andnot_si256(special, _mm256_and_si256(valid, _mm256_cmpgt_epi32(width, height_v)));
+				__m256i conj = _mm256_andnot_si256(special, _mm256_andnot_si256(direct, valid));
+
+				out.special |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(special)) << base;
+
+				bool any_direct = _mm256_movemask_ps(_mm256_castsi256_ps(direct));
+				bool any_conj = _mm256_movemask_ps(_mm256_castsi256_ps(conj));
+
+				// 64-bit versions of the conjugate mask, for lanes base, ..., base + 3 and base + 4, ..., base + 7
+				__m256i conj_lo_mask = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(conj));
+				__m256i conj_hi_mask = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(conj, 1));
+
+				__m256i direct_lo = _mm256_setzero_si256(), direct_hi = _mm256_setzero_si256();
+				__m256i conj_lo = _mm256_setzero_si256(), conj_hi = _mm256_setzero_si256();
+
+				for (int i = 0; i < child_height; ++i) {
+					__m256i r = lane_child_row8(lanes, i, base, row, col_v);
+
+					if (any_direct) {
+						__m256i power = _mm256_set1_epi64x(tables.powers[MAX_HEIGHT + 1 - (child_height - i)]);
+
+						direct_lo = _mm256_add_epi64(direct_lo, mul64_u32(power, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(r))));
+						direct_hi = _mm256_add_epi64(direct_hi, mul64_u32(power, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(r, 1))));
+					}
+
+					if (any_conj) {
+						__m256i idx = _mm256_sub_epi32(width, r);
+
+						conj_lo = _mm256_add_epi64(conj_lo, _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), prefix_sums,
+						                                                                _mm256_castsi256_si128(idx), conj_lo_mask, 8));
+						conj_hi = _mm256_add_epi64(conj_hi, _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), prefix_sums,
+						                                                                _mm256_extracti128_si256(idx, 1), conj_hi_mask, 8));
+					}
+				}
+
+				if (any_conj) {
+					__m256i height64 = _mm256_set1_epi64x(child_height);
+					__m256i total_lo = _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), prefix_sums, _mm256_castsi256_si128(width), conj_lo_mask, 8);
+					__m256i total_hi = _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), prefix_sums, _mm256_extracti128_si256(width, 1), conj_hi_mask, 8);
+
+					conj_lo = _mm256_sub_epi64(mul64_u32(total_lo, height64), conj_lo);
+					conj_hi = _mm256_sub_epi64(mul64_u32(total_hi, height64), conj_hi);
+				}
+
+				__m256i direct_lo_mask = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(direct));
+				__m256i direct_hi_mask = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(direct, 1));
+
+				_mm256_store_si256((__m256i*)(out.hashes + base), _mm256_blendv_epi8(conj_lo, direct_lo, direct_lo_mask));
+				_mm256_store_si256((__m256i*)(out.hashes + base + 4), _mm256_blendv_epi8(conj_hi, direct_hi, direct_hi_mask));
+			}
+		}
+
+		static const Kernels avx2_kernels = {
+			"avx2", cut_avx2, conjugate_avx2, orientation_avx2, hash_avx2, hash_conjugate_avx2, lane_cut_hashes_avx2
+		};
+
+		// AVX-512 kernels: 16 rows per vector, or 8 for the 64-bit hash arithmetic
+
+		#define CHOMP_AVX512 __attribute__((target("avx512f,avx512vl,avx512dq")))
+
+		CHOMP_AVX512 static inline __m512i iota16() {
+			return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		}
+
+		static inline __mmask16 lanes_below16(int i, int end) {
+			return (end - i >= 16) ? 0xffff : (__mmask16)((1u << (end - i)) - 1);
+		}
+
+		static inline __mmask8 lanes_below8_mask(int i, int end) {
+			return (end - i >= 8) ? 0xff : (__mmask8)((1u << (end - i)) - 1);
+		}
+
+		CHOMP_AVX512 static inline __m512i column_heights16(const int* rows, int height, int j) {
+			__m512i cols = _mm512_add_epi32(_mm512_set1_epi32(j), iota16());
+			__m512i counts = _mm512_setzero_si512();
+			__m512i ones = _mm512_set1_epi32(1);
+
+			for (int i = 0; i < height && rows[i] > j; ++i) {
+				counts = _mm512_mask_add_epi32(counts, _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(rows[i]), cols), counts, ones);
+			}
+
+			return counts;
+		}
+
+		// _mm512_reduce_add_epi64 and _mm512_cvtepu32_epi64 trip GCC's uninitialized warnings, so avoid them
+		CHOMP_AVX512 static inline uint64_t sum_lanes8(__m512i v) {
+			__m256i s = _mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xff, v, 0), _mm512_maskz_extracti64x4_epi64(0xff, v, 1));
+			return sum_lanes4(s);
+		}
+
+		CHOMP_AVX512 static int cut_avx512(const int* rows, int height, int row, int col, int* dst) {
+			int end = (col == 0) ? row : height;
+			__m512i row_v = _mm512_set1_epi32(row);
+			__m512i col_v = _mm512_set1_epi32(col);
+
+			for (int i = 0; i < end; i += 16) {
+				__mmask16 valid = lanes_below16(i, end);
+				__m512i idx = _mm512_add_epi32(_mm512_set1_epi32(i), iota16());
+				__m512i r = _mm512_maskz_loadu_epi32(valid, rows + i);
+
+				// Rows at or above the cut are limited to col
+				r = _mm512_mask_min_epi32(r, _mm512_cmpge_epi32_mask(idx, row_v), r, col_v);
+				_mm512_mask_storeu_epi32(dst + i, valid, r);
+			}
+
+			return end;
+		}
+
+		CHOMP_AVX512 static int conjugate_avx512(const int* rows, int height, int* dst) {
+			int width = (height > 0) ? std::min(rows[0], MAX_HEIGHT) : 0;
+
+			for (int j = 0; j < width; j += 16) {
+				_mm512_mask_storeu_epi32(dst + j, lanes_below16(j, width), column_heights16(rows, height, j));
+			}
+
+			return width;
+		}
+
+		CHOMP_AVX512 static Orientation orientation_avx512(const int* rows, int height) {
+			using O = Orientation;
+
+			if (height == 0) return O::SYMMETRICAL;
+			if (rows[0] > height) return O::CANONICAL;
+			if (rows[0] < height) return O::NOT_CANONICAL;
+
+			for (int j = 1; j < height; j += 16) {
+				__mmask16 valid = lanes_below16(j, height);
+				__m512i counts = column_heights16(rows, height, j);
+				__m512i r = _mm512_maskz_loadu_epi32(valid, rows + j);
+
+				__mmask16 differ = _mm512_mask_cmpneq_epi32_mask(valid, counts, r);
+
+				if (differ) {
+					__mmask16 first = differ & -differ;
+					return _mm512_mask_cmpgt_epi32_mask(first, counts, r) ? O::NOT_CANONICAL : O::CANONICAL;
+				}
+			}
+
+			return O::SYMMETRICAL;
+		}
+
+		CHOMP_AVX512 static uint64_t hash_avx512(const int* rows, int height) {
+			const uint64_t* powers = tables.powers + (MAX_HEIGHT + 1 - height);
+			__m512i acc = _mm512_setzero_si512();
+
+			for (int i = 0; i < height; i += 8) {
+				__m512i r = _mm512_maskz_cvtepu32_epi64(0xff, _mm256_maskz_loadu_epi32(lanes_below8_mask(i, height), rows + i));
+				__m512i p = _mm512_loadu_si512(powers + i);
+
+				acc = _mm512_add_epi64(acc, _mm512_mullo_epi64(r, p));
+			}
+
+			return sum_lanes8(acc);
+		}
+
+		CHOMP_AVX512 static uint64_t hash_conjugate_avx512(const int* rows, int height) {
+			if (height == 0) return 0;
+
+			int width = rows[0];
+			if (width > MAX_CONJUGATE_WIDTH) return hash_conjugate_scalar(rows, height);
+
+			__m256i width_v = _mm256_set1_epi32(width);
+			__m512i acc = _mm512_setzero_si512();
+
+			for (int i = 0; i < height; i += 8) {
+				__mmask8 valid = lanes_below8_mask(i, height);
+				__m256i idx = _mm256_sub_epi32(width_v, _mm256_maskz_loadu_epi32(valid, rows + i));
+
+				acc = _mm512_add_epi64(acc, _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), valid, idx, tables.prefix_sums, 8));
+			}
+
+			return (uint64_t)height * tables.prefix_sums[width] - sum_lanes8(acc);
+		}
+
+		CHOMP_AVX512 static inline __m512i lane_child_row16(const PositionLanes& lanes, int i, int row, __m512i col_v) {
+			__m512i r = _mm512_load_si512(lanes.rows[i]);
+			return (i < row) ? r : _mm512_maskz_min_epi32(0xffff, r, col_v);
+		}
+
+		// Low (half = 0) or high (half = 1) eight lanes of v
+		CHOMP_AVX512 static inline __m256i half_of(__m512i v, int half) {
+			return half ? _mm512_maskz_extracti32x8_epi32(0xff, v, 1) : _mm512_maskz_extracti32x8_epi32(0xff, v, 0);
+		}
+
+		CHOMP_AVX512 static inline __m512i widen_half(__m512i v, int half) {
+			return _mm512_maskz_cvtepu32_epi64(0xff, half_of(v, half));
+		}
+
+		CHOMP_AVX512 static void lane_cut_hashes_avx512(const PositionLanes& lanes, int row, int col, LaneHashes& out) {
+			int child_height = (col == 0) ? row : lanes.height;
+			__m512i col_v = _mm512_set1_epi32(col);
+			__m512i height_v = _mm512_set1_epi32(child_height);
+
+			__mmask16 valid = _mm512_mask_cmpgt_epi32_mask(lanes_below16(0, lanes.count), _mm512_load_si512(lanes.rows[row]), col_v);
+
+			out.valid = valid;
+			out.special = valid;
+			if (!valid || child_height <= 2) return;
+
+			__m512i width = lane_child_row16(lanes, 0, row, col_v);
+			__mmask16 special = _mm512_cmple_epi32_mask(width, _mm512_set1_epi32(2))
+				| _mm512_cmpeq_epi32_mask(lane_child_row16(lanes, 1, row, col_v), _mm512_set1_epi32(1))
+				| _mm512_cmpeq_epi32_mask(lane_child_row16(lanes, child_height - 1, row, col_v), width)
+				| _mm512_cmpeq_epi32_mask(width, height_v)
+				| _mm512_cmpgt_epi32_mask(width, _mm512_set1_epi32(MAX_CONJUGATE_WIDTH));
+			special &= valid;
+
+			__mmask16 direct = valid & ~special & _mm512_cmpgt_epi32_mask(width, height_v);
+			__mmask16 conj = valid & ~special & ~direct;
+
+			out.special = special;
+
+			__m512i direct_lo = _mm512_setzero_si512(), direct_hi = _mm512_setzero_si512();
+			__m512i conj_lo = _mm512_setzero_si512(), conj_hi = _mm512_setzero_si512();
+
+			for (int i = 0; i < child_height; ++i) {
+				__m512i r = lane_child_row16(lanes, i, row, col_v);
+
+				if (direct) {
+					__m512i power = _mm512_set1_epi64(tables.powers[MAX_HEIGHT + 1 - (child_height - i)]);
+
+					direct_lo = _mm512_add_epi64(direct_lo, _mm512_mullo_epi64(widen_half(r, 0), power));
+					direct_hi = _mm512_add_epi64(direct_hi, _mm512_mullo_epi64(widen_half(r, 1), power));
+				}
+
+				if (conj) {
+					__m512i idx = _mm512_sub_epi32(width, r);
+
+					conj_lo = _mm512_add_epi64(conj_lo, _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), (__mmask8)conj,
+					                                                                half_of(idx, 0), tables.prefix_sums, 8));
+					conj_hi = _mm512_add_epi64(conj_hi, _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), (__mmask8)(conj >> 8),
+					                                                                half_of(idx, 1), tables.prefix_sums, 8));
+				}
+			}
+
+			if (conj) {
+				__m512i height64 = _mm512_set1_epi64(child_height);
+				__m512i total_lo = _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), (__mmask8)conj, half_of(width, 0), tables.prefix_sums, 8);
+				__m512i total_hi = _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), (__mmask8)(conj >> 8), half_of(width, 1), tables.prefix_sums, 8);
+
+				conj_lo = _mm512_sub_epi64(_mm512_mullo_epi64(total_lo, height64), conj_lo);
+				conj_hi = _mm512_sub_epi64(_mm512_mullo_epi64(total_hi, height64), conj_hi);
+			}
+
+			_mm512_store_si512(out.hashes, _mm512_mask_blend_epi64((__mmask8)direct, conj_lo, direct_lo));
+			_mm512_store_si512(out.hashes + 8, _mm512_mask_blend_epi64((__mmask8)(direct >> 8), conj_hi, direct_hi));
+		}
+
+		static const Kernels avx512_kernels = {
+			"avx512", cut_avx512, conjugate_avx512, orientation_avx512, hash_avx512, hash_conjugate_avx512,
+			lane_cut_hashes_avx512
+		};
+#endif
+
+		const Kernels* get_kernels(const char* name) {
+			if (!std::strcmp(name, "scalar")) return &scalar_kernels;
+
+#if CHOMP_X86
+			__builtin_cpu_init();
+
+			if (!std::strcmp(name, "avx2") && __builtin_cpu_supports("avx2"))
+				return &avx2_kernels;
+			if (!std::strcmp(name, "avx512") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+			    && __builtin_cpu_supports("avx512dq"))
+				return &avx512_kernels;
+#endif
+
+			return nullptr;
+		}
+
+		static const Kernels* select_kernels() {
+			const char* forced = std::getenv("CHOMP_SIMD");
+
+			if (forced) {
+				const Kernels* k = get_kernels(forced);
+				if (k) return k;
+
+				std::fprintf(stderr, "CHOMP_SIMD=%s is unknown or unsupported on this CPU; ignoring\n", forced);
+			}
+
+			for (const char* name : { "avx512", "avx2" }) {
+				const Kernels* k = get_kernels(name);
+				if (k) return k;
+			}
+
+			return &scalar_kernels;
+		}
+
+		const Kernels* active = select_kernels();
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef CHOMP_SIMD_H
+#define CHOMP_SIMD_H
+
+#include <position.hpp>
+
+namespace Chomp {
+	namespace simd {
+		// Widest position whose conjugate hash is computed from the prefix table; wider ones use the scalar kernel
+		constexpr int MAX_CONJUGATE_WIDTH = 1024;
+
+		// Positions per lane group of the batch kernel
+		constexpr int LANES = 16;
+
+		/**
+		 * Up to LANES positions of the same height in structure-of-arrays layout, so that one vector holds the same row of
+		 * every position
+		 */
+		struct PositionLanes
+		{
+			alignas(64) int rows[MAX_HEIGHT][LANES];
+			int height;
+			// Number of lanes in use
+			int count;
+		};
+
+		/**
+		 * Canonical hashes of each lane's child for a single cut. Lanes in special are left to the caller, because the child
+		 * might be answered by the oracle, its orientation isn't decided by its width and height alone, or it is wider than
+		 * MAX_CONJUGATE_WIDTH. Hashes of lanes not in valid & ~special are unspecified.
+		 */
+		struct LaneHashes
+		{
+			uint32_t valid; // lanes where the cut exists
+			uint32_t special;
+			alignas(64) uint64_t hashes[LANES];
+		};
+
+		/**
+		 * Kernels for the per-position hot loops, operating on a rows array and height. Every implementation gives results
+		 * bit-identical to the scalar one. Rows at index height and beyond are never read, and may be garbage.
+		 */
+		struct Kernels
+		{
+			const char* name;
+
+			// Write the rows of the position cut at (row, col) to dst and return its height
+			int (*cut)(const int* rows, int height, int row, int col, int* dst);
+			// Write the conjugate (flip across the diagonal, chopped to MAX_HEIGHT rows) to dst and return its height
+			int (*conjugate)(const int* rows, int height, int* dst);
+			Orientation (*orientation)(const int* rows, int height);
+			uint64_t (*hash)(const int* rows, int height);
+			// Hash of the conjugate, without computing it
+			uint64_t (*hash_conjugate)(const int* rows, int height);
+
+			// Hash the children of every position in lanes for the cut (row, col)
+			void (*lane_cut_hashes)(const PositionLanes& lanes, int row, int col, LaneHashes& out);
+		};
+
+		// Best kernels supported by this CPU, chosen once at startup. Setting the environment variable CHOMP_SIMD to
+		// "scalar", "avx2" or "avx512" overrides the choice, if the CPU supports it
+		extern const Kernels* active;
+
+		// Kernels by name, or nullptr if unknown or unsupported by this CPU
+		const Kernels* get_kernels(const char* name);
+	}
+}
+
+#endif //CHOMP_SIMD_H
@@ -0,0 +1,96 @@
+#include <position.hpp>
+#include <spill.hpp>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace Chomp {
+	namespace spill {
+		MappedFile::MappedFile(const std::string& filename, const std::function<void(FILE*)>& write) {
+			FILE* f = fopen(filename.c_str(), "wb+");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open spill file");
+
+			// Per call, so that several files can be written at once
+			std::vector<char> buffer(1 << 20);
+			std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+			try {
+				write(f);
+			} catch (...) {
+				// Close before the buffer goes away
+				fclose(f);
+				unlink(filename.c_str());
+				throw;
+			}
+
+			bool ok = !ferror(f) && fflush(f) == 0;
+			size = ftell(f);
+
+			// mmap can't map an empty file
+			if (ok && size > 0) {
+				mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(f), 0);
+				ok = mapping != MAP_FAILED;
+				if (!ok) mapping = nullptr;
+			}
+
+			fclose(f);
+			// The mapping keeps the data; the name is no longer needed
+			unlink(filename.c_str());
+
+			if (!ok) throw std::runtime_error(FILE_LINE"Failed to write spill file");
+		}
+
+		MappedFile::~MappedFile() {
+			if (mapping) munmap(mapping, size);
+		}
+
+		size_t interpolation_search(const uint64_t* keys, size_t count, uint64_t key) {
+			size_t lo = 0, hi = count; // answer in [lo, hi]
+			// Set after a guess misses its window, so that skewed keys cost at most twice the probes of a binary search
+			bool bisect = false;
+
+			while (hi - lo > 8) {
+				uint64_t lo_key = keys[lo], hi_key = keys[hi - 1];
+				if (key <= lo_key) return lo;
+				if (key > hi_key) return hi;
+
+				if (bisect) {
+					size_t mid = lo + (hi - lo) / 2;
+
+					if (keys[mid] < key)
+						lo = mid + 1;
+					else
+						hi = mid;
+
+					bisect = false;
+					continue;
+				}
+
+				// Guess by linear interpolation between the ends, then check a window around the guess
+				double fraction = (double) (key - lo_key) / (double) (hi_key - lo_key);
+				size_t guess = lo + (size_t) (fraction * (hi - 1 - lo));
+				size_t step = std::max<size_t>((hi - lo) / 64, 1);
+
+				size_t window_lo = (guess > lo + step) ? guess - step : lo;
+				size_t window_hi = std::min(guess + step, hi - 1);
+
+				if (keys[window_lo] >= key) {
+					hi = window_lo + 1;
+					bisect = true;
+				} else if (keys[window_hi] < key) {
+					lo = window_hi + 1;
+					bisect = true;
+				} else {
+					lo = window_lo;
+					hi = window_hi + 1;
+				}
+			}
+
+			while (lo < hi && keys[lo] < key) lo++;
+			return lo;
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef CHOMP_SPILL_H
+#define CHOMP_SPILL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Chomp {
+	namespace spill {
+		// A file written once, then mapped read-only
+		class MappedFile {
+		private:
+			void* mapping = nullptr;
+			size_t size = 0;
+		public:
+			// Call write to fill filename, then map it
+			MappedFile(const std::string& filename, const std::function<void(FILE*)>& write);
+			~MappedFile();
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			const uint8_t* data() const { return (const uint8_t*) mapping; }
+		};
+
+		/**
+		 * Index of the first key >= key in a sorted array. Keys are hashes, so they are close to uniform and interpolation
+		 * takes O(log log n) probes. Each guess that misses its window is followed by a bisection step, so skewed keys take
+		 * O(log n)
+		 */
+		size_t interpolation_search(const uint64_t* keys, size_t count, uint64_t key);
+
+		/**
+		 * Entries of one level moved out of a table: sorted keys, then their values in the same order, in one mapped file.
+		 * A level is normally spilled once; spilling more of it, once a solve has grown the bounds, merges the new entries
+		 * with the run into a new one, so a lookup is always a single search
+		 * @tparam Info Trivially copyable value type
+		 */
+		template <typename Info>
+		class Run {
+		private:
+			std::unique_ptr<MappedFile> file;
+			const uint64_t* keys = nullptr;
+			const Info* infos = nullptr;
+			size_t count = 0;
+		public:
+			bool empty() const { return count == 0; }
+			size_t size() const { return count; }
+
+			/**
+			 * Replace the run with its merge with entries, streamed to filename. The previous file is removed
+			 * @param entries Not in the run already; sorted in place
+			 */
+			void add(const std::string& filename, std::vector<std::pair<uint64_t, Info>>& entries) {
+				std::sort(entries.begin(), entries.end(), [] (const auto& a, const auto& b) { return a.first < b.first; });
+
+				// Where each merged entry comes from, one pass for the keys and one for the values
+				auto merge = [&] (auto emit_old, auto emit_new) {
+					size_t i = 0, j = 0;
+					while (i < count || j < entries.size()) {
+						if (j == entries.size() || (i < count && keys[i] < entries[j].first))
+							emit_old(i++);
+						else
+							emit_new(j++);
+					}
+				};
+
+				auto merged = std::make_unique<MappedFile>(filename, [&] (FILE* f) {
+					merge([&] (size_t i) { fwrite(&keys[i], sizeof(uint64_t), 1, f); },
+					      [&] (size_t j) { fwrite(&entries[j].first, sizeof(uint64_t), 1, f); });
+					merge([&] (size_t i) { fwrite(&infos[i], sizeof(Info), 1, f); },
+					      [&] (size_t j) { fwrite(&entries[j].second, sizeof(Info), 1, f); });
+				});
+
+				count += entries.size();
+				file = std::move(merged);
+				keys = (const uint64_t*) file->data();
+				infos = (const Info*) (file->data() + count * sizeof(uint64_t));
+			}
+
+			const Info* find(uint64_t key) const {
+				if (!count) return nullptr;
+
+				size_t i = interpolation_search(keys, count, key);
+				return (i < count && keys[i] == key) ? &infos[i] : nullptr;
+			}
+		};
+	}
+}
+
+#endif //CHOMP_SPILL_H
@@ -0,0 +1,111 @@
+#ifndef CHOMP_STATS_H
+#define CHOMP_STATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+// Solver statistics: 0 for none, 1 for position/winning move/losing counts, 2 for counts plus a histogram of winning moves
+#ifndef CHOMP_STATS
+#define CHOMP_STATS 1
+#endif
+
+namespace Chomp {
+	namespace stats {
+		// Policies are accumulated per worker and merged once per batch, so workers never share a counter
+
+		// No accounting; every call compiles away
+		struct None {
+			void add_position(int) {}
+			void add_winning(int, int) {}
+			void add_losing(int) {}
+
+			void merge(const None&) {}
+			void clear() {}
+
+			void print_level(int n, long long level_ms, uint64_t level_allocations) const {
+				std::printf("%i %lld %llu\n", n, level_ms, (unsigned long long) level_allocations);
+			}
+		};
+
+		struct Counters {
+			uint64_t positions = 0;
+			uint64_t winning_moves = 0;
+			uint64_t losing_positions = 0;
+
+			void add_position(int multiplicity) { positions += multiplicity; }
+			void add_winning(int moves, int multiplicity) { winning_moves += (uint64_t) moves * multiplicity; }
+			void add_losing(int multiplicity) { losing_positions += multiplicity; }
+
+			void merge(const Counters& other) {
+				positions += other.positions;
+				winning_moves += other.winning_moves;
+				losing_positions += other.losing_positions;
+			}
+
+			void clear() { positions = winning_moves = losing_positions = 0; }
+
+			void print_level(int n, long long level_ms, uint64_t level_allocations) const {
+				std::printf("%i %llu %llu %llu %lld %llu\n", n, (unsigned long long) positions, (unsigned long long) winning_moves,
+				            (unsigned long long) losing_positions, level_ms, (unsigned long long) level_allocations);
+			}
+		};
+
+		struct Histograms : Counters {
+			// Number of positions with each number of winning moves. Cleared without freeing, so it only allocates while it
+			// grows to the widest level
+			std::vector<uint64_t> winning_moves_histogram;
+
+			void count(int moves, int multiplicity) {
+				if ((size_t) moves >= winning_moves_histogram.size()) winning_moves_histogram.resize(moves + 1);
+				winning_moves_histogram[moves] += multiplicity;
+			}
+
+			void add_winning(int moves, int multiplicity) {
+				Counters::add_winning(moves, multiplicity);
+				count(moves, multiplicity);
+			}
+
+			void add_losing(int multiplicity) {
+				Counters::add_losing(multiplicity);
+				count(0, multiplicity);
+			}
+
+			void merge(const Histograms& other) {
+				Counters::merge(other);
+
+				if (winning_moves_histogram.size() < other.winning_moves_histogram.size())
+					winning_moves_histogram.resize(other.winning_moves_histogram.size());
+				for (size_t i = 0; i < other.winning_moves_histogram.size(); ++i)
+					winning_moves_histogram[i] += other.winning_moves_histogram[i];
+			}
+
+			void clear() {
+				Counters::clear();
+				std::fill(winning_moves_histogram.begin(), winning_moves_histogram.end(), 0);
+			}
+
+			void print_level(int n, long long level_ms, uint64_t level_allocations) const {
+				Counters::print_level(n, level_ms, level_allocations);
+
+				std::printf("  winning moves:");
+				for (size_t i = 0; i < winning_moves_histogram.size(); ++i) {
+					if (winning_moves_histogram[i])
+						std::printf(" %zu:%llu", i, (unsigned long long) winning_moves_histogram[i]);
+				}
+				std::printf("\n");
+			}
+		};
+
+#if CHOMP_STATS == 0
+		using Policy = None;
+#elif CHOMP_STATS == 1
+		using Policy = Counters;
+#else
+		using Policy = Histograms;
+#endif
+	}
+}
+
+#endif //CHOMP_STATS_H
@@ -5,7 +5,16 @@
 * @Last Modified time: 2021-11-01 20:00:11
 */
 
-#include <position.hpp>
+#include <store.hpp>
+#include <parallel_hashmap/phmap_dump.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace Chomp {
 	namespace store {
@@ -42,5 +51,434 @@ namespace Chomp {
 
 			fclose(f);
 		}
+
+		// Values are written raw, so bump this whenever LosingPositionInfo or WinningPositionInfo change layout
+		static const char checkpoint_magic[8] = { 'C', 'H', 'O', 'M', 'P', 'C', 'K', '2' };
+
+		template <typename Map>
+		static void write_entries(const Map &map, FILE *f) {
+			uint64_t size = map.size();
+			fwrite(&size, sizeof(size), 1, f);
+
+			for (const auto &element : map) {
+				fwrite(&element.first, sizeof(element.first), 1, f);
+				fwrite(&element.second, sizeof(element.second), 1, f);
+			}
+		}
+
+		template <typename Map>
+		static bool read_entries(Map &map, FILE *f) {
+			uint64_t size;
+			if (fread(&size, sizeof(size), 1, f) != 1) return false;
+
+			map.clear();
+			map.reserve(size);
+
+			for (uint64_t i = 0; i < size; ++i) {
+				typename Map::key_type key;
+				typename Map::mapped_type value;
+
+				if (fread(&key, sizeof(key), 1, f) != 1 || fread(&value, sizeof(value), 1, f) != 1) return false;
+				map[key] = value;
+			}
+
+			return true;
+		}
+
+		// Flush a rename in the directory holding filename to disk
+		static void sync_directory(const char *filename) {
+			std::string directory = filename;
+			size_t slash = directory.rfind('/');
+			directory = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : directory.substr(0, slash);
+
+			int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+			bool ok = fd >= 0 && fsync(fd) == 0;
+			if (fd >= 0) close(fd);
+
+			if (!ok) throw std::runtime_error(FILE_LINE"Failed to sync directory");
+		}
+
+		void write_checkpoint(const CheckpointMetadata &metadata, const map_type &losing, const winning_map_type &winning,
+		                      const char *filename) {
+			std::string temporary = std::string(filename) + ".tmp";
+
+			FILE *f = fopen(temporary.c_str(), "wb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open checkpoint file");
+
+			std::vector<char> buffer(1 << 20);
+			std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+			// Field by field into zeroed bytes, so that the padding written is zeros rather than whatever was on the stack
+			unsigned char raw_metadata[sizeof(CheckpointMetadata)] = {};
+			auto put = [&] (size_t offset, const auto &field) { memcpy(raw_metadata + offset, &field, sizeof(field)); };
+
+			put(offsetof(CheckpointMetadata, completed_level), metadata.completed_level);
+			put(offsetof(CheckpointMetadata, bound_width), metadata.bound_width);
+			put(offsetof(CheckpointMetadata, bound_height), metadata.bound_height);
+			put(offsetof(CheckpointMetadata, compute_dte), metadata.compute_dte);
+			put(offsetof(CheckpointMetadata, compute_winning_moves), metadata.compute_winning_moves);
+			put(offsetof(CheckpointMetadata, compute_best_moves), metadata.compute_best_moves);
+			put(offsetof(CheckpointMetadata, probes_eliminated), metadata.probes_eliminated);
+			put(offsetof(CheckpointMetadata, stores_eliminated), metadata.stores_eliminated);
+
+			fwrite(checkpoint_magic, sizeof(checkpoint_magic), 1, f);
+			fwrite(raw_metadata, sizeof(raw_metadata), 1, f);
+			write_entries(losing, f);
+			write_entries(winning, f);
+			// Trailer, so that a truncated file is never taken for a checkpoint
+			fwrite(checkpoint_magic, sizeof(checkpoint_magic), 1, f);
+
+			// A short write anywhere sets the error indicator, which fflush alone wouldn't report
+			bool ok = !ferror(f) && fflush(f) == 0 && fsync(fileno(f)) == 0;
+			ok = (fclose(f) == 0) && ok;
+
+			if (!ok || std::rename(temporary.c_str(), filename) != 0)
+				throw std::runtime_error(FILE_LINE"Failed to write checkpoint");
+
+			// Otherwise a crash could leave the old checkpoint, or none, in place of the new one
+			sync_directory(filename);
+		}
+
+		bool read_checkpoint(CheckpointMetadata &metadata, map_type &losing, winning_map_type &winning, const char *filename) {
+			FILE *f = fopen(filename, "rb");
+			if (!f) return false;
+
+			char magic[sizeof(checkpoint_magic)], trailer[sizeof(checkpoint_magic)];
+			bool ok = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, checkpoint_magic, sizeof(magic))
+				&& fread(&metadata, sizeof(metadata), 1, f) == 1
+				&& read_entries(losing, f) && read_entries(winning, f)
+				&& fread(trailer, sizeof(trailer), 1, f) == 1 && !memcmp(trailer, checkpoint_magic, sizeof(trailer));
+
+			fclose(f);
+			if (!ok) throw std::runtime_error(FILE_LINE"Corrupt checkpoint");
+
+			return true;
+		}
+
+		static const char level_magic[8] = { 'C', 'H', 'O', 'M', 'P', 'L', 'V', '1' };
+		static const int MAX_QUEUED_LEVELS = 4;
+
+		static void put_varint(std::vector<uint8_t> &out, uint64_t value) {
+			while (value >= 0x80) {
+				out.push_back((uint8_t) (value | 0x80));
+				value >>= 7;
+			}
+
+			out.push_back((uint8_t) value);
+		}
+
+		static bool get_varint(const uint8_t *&in, const uint8_t *end, uint64_t &value) {
+			value = 0;
+
+			for (int shift = 0; shift < 64 && in < end; shift += 7) {
+				uint8_t byte = *in++;
+				value |= (uint64_t) (byte & 0x7f) << shift;
+
+				if (!(byte & 0x80)) return true;
+			}
+
+			return false;
+		}
+
+		LevelWriter::LevelWriter(LevelSink sink) : sink(std::move(sink)), queue(MAX_QUEUED_LEVELS) {
+			thread = std::thread([this] { work(); });
+		}
+
+		LevelWriter::~LevelWriter() {
+			stop();
+		}
+
+		void LevelWriter::stop() {
+			if (!thread.joinable()) return;
+
+			queue.push(nullptr);
+			thread.join();
+		}
+
+		void LevelWriter::submit(int n, LevelEntries &&entries) {
+			if (failed.load(std::memory_order_acquire)) std::rethrow_exception(error);
+
+			queue.push(new Level { n, std::move(entries) });
+		}
+
+		void LevelWriter::finish() {
+			stop();
+			if (error) std::rethrow_exception(error);
+		}
+
+		void LevelWriter::work() {
+			while (Level *level = queue.pop()) {
+				std::unique_ptr<Level> owned(level);
+				// Keep draining after a failure, so that submit never blocks on a full queue
+				if (error) continue;
+
+				LevelEntries &entries = level->entries;
+
+				try {
+					std::sort(entries.begin(), entries.end(), [] (const auto &a, const auto &b) { return a.first < b.first; });
+					sink(level->n, entries);
+				} catch (...) {
+					error = std::current_exception();
+					failed.store(true, std::memory_order_release);
+				}
+			}
+		}
+
+		void write_level(const char *directory, int n, const LevelEntries &entries) {
+			std::vector<uint8_t> encoded;
+			uint64_t previous = 0;
+
+			for (const auto &[key, info] : entries) {
+				put_varint(encoded, key - previous);
+				put_varint(encoded, info.dte);
+				previous = key;
+			}
+
+			std::string filename = std::string(directory) + "/level_" + std::to_string(n) + ".bin";
+			std::string temporary = filename + ".tmp";
+
+			FILE *f = fopen(temporary.c_str(), "wb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open level file");
+
+			uint64_t header[2] = { (uint64_t) n, entries.size() };
+			fwrite(level_magic, sizeof(level_magic), 1, f);
+			fwrite(header, sizeof(header), 1, f);
+			fwrite(encoded.data(), 1, encoded.size(), f);
+
+			bool ok = !ferror(f) && fflush(f) == 0 && fsync(fileno(f)) == 0;
+			ok = (fclose(f) == 0) && ok;
+
+			if (!ok || std::rename(temporary.c_str(), filename.c_str()) != 0)
+				throw std::runtime_error(FILE_LINE"Failed to write level file");
+		}
+
+		void read_level(map_type &map, const char *filename) {
+			FILE *f = fopen(filename, "rb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open level file");
+
+			char magic[sizeof(level_magic)];
+			uint64_t header[2];
+
+			if (fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, level_magic, sizeof(magic)) || fread(header, sizeof(header), 1, f) != 1) {
+				fclose(f);
+				throw std::runtime_error(FILE_LINE"Not a level file");
+			}
+
+			std::vector<uint8_t> encoded;
+			uint8_t buf[1 << 16];
+			size_t read;
+			while ((read = fread(buf, 1, sizeof(buf), f)) > 0) encoded.insert(encoded.end(), buf, buf + read);
+			fclose(f);
+
+			const uint8_t *in = encoded.data(), *end = in + encoded.size();
+			uint64_t key = 0;
+			map.reserve(map.size() + header[1]);
+
+			for (uint64_t i = 0; i < header[1]; ++i) {
+				uint64_t delta, dte;
+				if (!get_varint(in, end, delta) || !get_varint(in, end, dte))
+					throw std::runtime_error(FILE_LINE"Truncated level file");
+
+				key += delta;
+				map[key] = { .dte = (int) dte };
+			}
+		}
+
+		// As with checkpoints, bump this whenever the region or the table values change layout
+		static const char snapshot_magic[8] = { 'C', 'H', 'O', 'M', 'P', 'S', 'N', '4' };
+		static const size_t SNAPSHOT_BLOOM_CHUNK_WORDS = 1 << 13; // 64 KB
+
+		// phmap archive over a FILE*, remembering whether any read or write failed
+		class SnapshotArchive {
+		private:
+			FILE *f;
+		public:
+			bool ok = true;
+
+			explicit SnapshotArchive(FILE *f) : f(f) {}
+
+			bool dump(const char *p, size_t size) {
+				ok = ok && fwrite(p, 1, size, f) == size;
+				return ok;
+			}
+
+			template <typename V>
+			bool dump(const V &v) {
+				return dump((const char *) &v, sizeof(V));
+			}
+
+			bool load(char *p, size_t size) {
+				ok = ok && fread(p, 1, size, f) == size;
+				return ok;
+			}
+
+			template <typename V>
+			bool load(V *v) {
+				return load((char *) v, sizeof(V));
+			}
+		};
+
+		void write_snapshot(const map_type &losing, const winning_map_type &winning, const datastructs::BloomFilter &bloom,
+		                    const SolvedRegion &region, const char *filename) {
+			std::string temporary = std::string(filename) + ".tmp";
+
+			FILE *f = fopen(temporary.c_str(), "wb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open snapshot file");
+
+			std::vector<char> buffer(1 << 22);
+			std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+			SnapshotArchive ar(f);
+			ar.dump(snapshot_magic, sizeof(snapshot_magic));
+			ar.dump((int32_t) region.max_squares);
+			ar.dump((int32_t) region.bound_width);
+			ar.dump((int32_t) region.bound_height);
+			ar.dump((int32_t) region.has_dte);
+			losing.dump(ar);
+			winning.dump(ar);
+
+			const uint64_t *bits = bloom.data();
+			for (size_t chunk = 0; chunk < datastructs::BloomFilter::size_words; chunk += SNAPSHOT_BLOOM_CHUNK_WORDS) {
+				const uint64_t *begin = bits + chunk, *end = begin + SNAPSHOT_BLOOM_CHUNK_WORDS;
+				uint8_t nonzero = std::any_of(begin, end, [] (uint64_t word) { return word != 0; });
+
+				ar.dump(nonzero);
+				if (nonzero) ar.dump((const char *) begin, SNAPSHOT_BLOOM_CHUNK_WORDS * sizeof(uint64_t));
+			}
+
+			ar.dump(snapshot_magic, sizeof(snapshot_magic));
+
+			bool ok = ar.ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+			ok = (fclose(f) == 0) && ok;
+
+			if (!ok || std::rename(temporary.c_str(), filename) != 0)
+				throw std::runtime_error(FILE_LINE"Failed to write snapshot");
+		}
+
+		void read_snapshot(map_type &losing, winning_map_type &winning, datastructs::BloomFilter &bloom, SolvedRegion &region,
+		                   const char *filename) {
+			FILE *f = fopen(filename, "rb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open snapshot file");
+
+			std::vector<char> buffer(1 << 22);
+			std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+			SnapshotArchive ar(f);
+			char magic[sizeof(snapshot_magic)];
+
+			int32_t bounds[4];
+
+			ar.load(magic, sizeof(magic));
+			bool ok = ar.ok && !memcmp(magic, snapshot_magic, sizeof(magic)) && ar.load(&bounds) && losing.load(ar)
+				&& winning.load(ar);
+			if (ok) region = { bounds[0], bounds[1], bounds[2], bounds[3] != 0 };
+
+			uint64_t *bits = bloom.data();
+			for (size_t chunk = 0; ok && chunk < datastructs::BloomFilter::size_words; chunk += SNAPSHOT_BLOOM_CHUNK_WORDS) {
+				uint8_t nonzero = 0;
+				ok = ar.load(&nonzero);
+
+				if (ok && nonzero) ok = ar.load((char *) (bits + chunk), SNAPSHOT_BLOOM_CHUNK_WORDS * sizeof(uint64_t));
+			}
+
+			ok = ok && ar.load(magic, sizeof(magic)) && !memcmp(magic, snapshot_magic, sizeof(magic));
+			fclose(f);
+
+			if (!ok) throw std::runtime_error(FILE_LINE"Corrupt snapshot");
+		}
+
+		static const size_t LEGACY_ENTRY_SIZE = sizeof(uint64_t) + sizeof(uint16_t);
+		static const size_t SHARD_BUFFER_ENTRIES = 1 << 16;
+
+		static std::string shard_filename(const char *prefix, size_t shard) {
+			return std::string(prefix) + "." + std::to_string(shard);
+		}
+
+		template <typename F>
+		static void for_each_shard(F f) {
+			std::vector<std::thread> threads;
+			std::vector<std::exception_ptr> errors(map_type::subcnt());
+
+			for (size_t shard = 0; shard < map_type::subcnt(); ++shard) {
+				threads.emplace_back([&, shard] {
+					try {
+						f(shard);
+					} catch (...) {
+						errors[shard] = std::current_exception();
+					}
+				});
+			}
+
+			for (std::thread &thread : threads) thread.join();
+			for (std::exception_ptr &error : errors)
+				if (error) std::rethrow_exception(error);
+		}
+
+		void write_map_sharded(const map_type &map, const char *prefix) {
+			for_each_shard([&] (size_t shard) {
+				std::string filename = shard_filename(prefix, shard);
+
+				FILE *f = fopen(filename.c_str(), "wb");
+				if (!f) throw std::runtime_error(FILE_LINE"Failed to open shard file");
+
+				std::vector<uint8_t> buffer(SHARD_BUFFER_ENTRIES * LEGACY_ENTRY_SIZE);
+				size_t used = 0;
+				bool ok = true;
+
+				map.with_submap(shard, [&] (const auto &submap) {
+					for (const auto &element : submap) {
+						uint16_t position_info = element.second.dte;
+
+						memcpy(&buffer[used], &element.first, sizeof(element.first));
+						memcpy(&buffer[used + sizeof(element.first)], &position_info, sizeof(position_info));
+						used += LEGACY_ENTRY_SIZE;
+
+						if (used == buffer.size()) {
+							ok = ok && fwrite(buffer.data(), 1, used, f) == used;
+							used = 0;
+						}
+					}
+				});
+
+				ok = ok && fwrite(buffer.data(), 1, used, f) == used;
+				ok = (fclose(f) == 0) && ok;
+
+				if (!ok) throw std::runtime_error(FILE_LINE"Failed to write shard file");
+			});
+		}
+
+		void read_map_sharded(map_type &map, const char *prefix) {
+			for_each_shard([&] (size_t shard) {
+				std::string filename = shard_filename(prefix, shard);
+
+				FILE *f = fopen(filename.c_str(), "rb");
+				if (!f) throw std::runtime_error(FILE_LINE"Failed to open shard file");
+
+				fseek(f, 0, SEEK_END);
+				size_t entries = ftell(f) / LEGACY_ENTRY_SIZE;
+				fseek(f, 0, SEEK_SET);
+
+				std::vector<uint8_t> buffer(SHARD_BUFFER_ENTRIES * LEGACY_ENTRY_SIZE);
+
+				// Only this thread touches this submap
+				map.with_submap_m(shard, [&] (auto &submap) {
+					submap.reserve(submap.size() + entries);
+
+					size_t read;
+					while ((read = fread(buffer.data(), LEGACY_ENTRY_SIZE, SHARD_BUFFER_ENTRIES, f)) > 0) {
+						for (size_t i = 0; i < read; ++i) {
+							uint64_t key;
+							uint16_t position_info;
+							memcpy(&key, &buffer[i * LEGACY_ENTRY_SIZE], sizeof(key));
+							memcpy(&position_info, &buffer[i * LEGACY_ENTRY_SIZE + sizeof(key)], sizeof(position_info));
+
+							submap.emplace(key, LosingPositionInfo { .dte = position_info & ((1 << 15) - 1) });
+						}
+					}
+				});
+
+				fclose(f);
+			});
+		}
 	}
-}
\ No newline at end of file
+}
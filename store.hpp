@@ -1,10 +1,112 @@
+#ifndef CHOMP_STORE_H
+#define CHOMP_STORE_H
 
 #include <position.hpp>
+#include <datastructs.hpp>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <memory>
+#include <functional>
 
 namespace Chomp {
 	namespace store {
 		void write_map(const map_type &map, const char *filename);
 
 		void read_map(map_type &map, const char *filename);
+
+		/**
+		 * Write each submap to its own file, <prefix>.<i>, each from its own thread. The files are in the write_map format,
+		 * so each can also be read on its own with read_map
+		 */
+		void write_map_sharded(const map_type &map, const char *prefix);
+
+		// Read the files of write_map_sharded, each thread filling the submap its file came from
+		void read_map_sharded(map_type &map, const char *prefix);
+
+		// What a checkpoint was solved with, and how far it got
+		struct CheckpointMetadata {
+			int32_t completed_level;
+			int32_t bound_width;
+			int32_t bound_height;
+			uint8_t compute_dte;
+			uint8_t compute_winning_moves;
+			uint8_t compute_best_moves;
+			uint64_t probes_eliminated;
+			uint64_t stores_eliminated;
+		};
+
+		/**
+		 * Write both tables and the metadata to a temporary file, flush it to disk, then rename it over filename, so that
+		 * filename always holds a complete checkpoint
+		 */
+		void write_checkpoint(const CheckpointMetadata &metadata, const map_type &losing, const winning_map_type &winning,
+		                      const char *filename);
+
+		/**
+		 * Read a checkpoint written by write_checkpoint into the (cleared) tables
+		 * @return false if there is no checkpoint at filename
+		 */
+		bool read_checkpoint(CheckpointMetadata &metadata, map_type &losing, winning_map_type &winning, const char *filename);
+
+		using LevelEntries = std::vector<std::pair<uint64_t, LosingPositionInfo>>;
+
+		// Called with each completed level's losing positions, sorted by key
+		using LevelSink = std::function<void(int n, const LevelEntries &entries)>;
+
+		/**
+		 * Hands completed levels to a sink on its own thread, so the solver can get on with the next level
+		 */
+		class LevelWriter {
+		private:
+			struct Level {
+				int n;
+				LevelEntries entries;
+			};
+
+			LevelSink sink;
+			// nullptr asks the thread to finish
+			datastructs::SpscRing<Level*> queue;
+			std::thread thread;
+
+			// First exception the sink threw, set before failed; later levels are dropped
+			std::exception_ptr error;
+			std::atomic<bool> failed{false};
+
+			void work();
+			// Ask the thread to finish and wait for it, once
+			void stop();
+		public:
+			explicit LevelWriter(LevelSink sink);
+			// Waits for the queued levels to be written, dropping any error (see finish)
+			~LevelWriter();
+
+			// Blocks if too many levels are already waiting to be written. Rethrows the sink's error, if it has failed
+			void submit(int n, LevelEntries &&entries);
+			// Wait for the queued levels to be written, then rethrow the sink's error, if any
+			void finish();
+		};
+
+		/**
+		 * Write a level to <directory>/level_<n>.bin. Keys are delta coded as varints, each followed by its dte
+		 * @param entries Sorted by key
+		 */
+		void write_level(const char *directory, int n, const LevelEntries &entries);
+
+		// Read a file written by write_level into map
+		void read_level(map_type &map, const char *filename);
+
+		/**
+		 * Snapshot of the tables' control and slot arrays (phmap's dump) plus the filter bits. Chunks of the filter that are
+		 * all zero are skipped, so a small table makes a small snapshot
+		 */
+		void write_snapshot(const map_type &losing, const winning_map_type &winning, const datastructs::BloomFilter &bloom,
+		                    const SolvedRegion &region, const char *filename);
+
+		// Replaces the tables and region; the filter is assumed to be empty, as in a fresh process
+		void read_snapshot(map_type &losing, winning_map_type &winning, datastructs::BloomFilter &bloom, SolvedRegion &region,
+		                   const char *filename);
 	}
-}
\ No newline at end of file
+}
+
+#endif //CHOMP_STORE_H
@@ -0,0 +1,265 @@
+#include <strategy.hpp>
+#include <datastructs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+namespace Chomp {
+	namespace strategy {
+		void Children::evaluate(const Position& p) {
+			cuts.clear();
+			positions.clear();
+
+			p.for_each_cut([&] (Cut c) {
+				cuts.push_back(c);
+				positions.push_back(p.cut(c));
+			});
+
+			infos.resize(positions.size());
+			info_batch(positions, infos);
+		}
+
+		Cut winning_cut_shortest_delay(const Position& p, Children& children) {
+			Cut recorded = p.recorded_best_move();
+			if (recorded.first >= 0) return recorded;
+
+			children.evaluate(p);
+
+			Cut ret = { -1, -1 };
+			int min_dte = INT_MAX;
+
+			for (size_t i = 0; i < children.cuts.size(); ++i) {
+				const PositionInfo& child = children.infos[i];
+
+				if (!child.is_winning && child.dte < min_dte) {
+					min_dte = child.dte;
+					ret = children.cuts[i];
+				}
+			}
+
+			return ret;
+		}
+
+		Cut losing_cut_longest_delay(const Position& p, Children& children) {
+			children.evaluate(p);
+
+			Cut ret = { -1, -1 };
+			int max_dte = -1;
+
+			for (size_t i = 0; i < children.cuts.size(); ++i) {
+				if (children.infos[i].dte > max_dte) {
+					max_dte = children.infos[i].dte;
+					ret = children.cuts[i];
+				}
+			}
+
+			return ret;
+		}
+
+		Cut losing_cut_trickiest_ratio(const Position& p, Children& children) {
+			children.evaluate(p);
+
+			Cut ret = { -1, -1 };
+			// Fraction best_winning / best_cuts, compared by cross-multiplying
+			int64_t best_winning = 1, best_cuts = 0;
+			int best_dte = -1;
+
+			// The poisoned square, cut (0, 0), comes first and loses at once; it is only taken when it is the only cut
+			if (children.cuts.size() == 1) return children.cuts[0];
+
+			for (size_t i = 1; i < children.cuts.size(); ++i) {
+				const Position& child = children.positions[i];
+				int64_t winning = children.infos[i].is_winning ? child.num_winning_cuts() : 0;
+				int64_t cuts = child.square_count();
+
+				int64_t lhs = winning * best_cuts, rhs = best_winning * cuts;
+				if (ret.first < 0 || lhs < rhs || (lhs == rhs && children.infos[i].dte > best_dte)) {
+					best_winning = winning;
+					best_cuts = cuts;
+					best_dte = children.infos[i].dte;
+					ret = children.cuts[i];
+				}
+			}
+
+			return ret;
+		}
+
+		static Cut random_cut(const Position& p, std::mt19937_64& random) {
+			return p.nth_cut(std::uniform_int_distribution<int>(0, p.square_count() - 1)(random));
+		}
+
+		Cut choose(const Position& p, Policy policy, Children& children, std::mt19937_64& random) {
+			if (p.height == 0) return { -1, -1 };
+			if (policy == Policy::RANDOM) return random_cut(p, random);
+
+			if (p.info().is_winning) return winning_cut_shortest_delay(p, children);
+
+			return (policy == Policy::TRICKIEST_RATIO) ? losing_cut_trickiest_ratio(p, children)
+			                                           : losing_cut_longest_delay(p, children);
+		}
+
+		// Every position of a game fits wherever its start does, so checking the start covers the whole game. Every policy
+		// but RANDOM compares dtes
+		static void check_start(const Position& start, bool needs_dte) {
+			SolvedRegion region = answered_region();
+
+			if (!region.contains(start.square_count(), start.get_width(), start.get_height()))
+				throw std::runtime_error(FILE_LINE"Start position outside the solved tables");
+			if (needs_dte && !region.has_dte)
+				throw std::runtime_error(FILE_LINE"Policy needs tables solved with dtes");
+		}
+
+		std::vector<Cut> play_game(const Position& start, Policy policy, FILE* f) {
+			check_start(start, policy != Policy::RANDOM);
+
+			Children children;
+			std::mt19937_64 random(1);
+			std::vector<Cut> cuts;
+
+			if (f) std::fprintf(f, "Beginning from position %s\n", start.list().c_str());
+
+			for (Position p = start; p.height > 0; ) {
+				int player = 1 + cuts.size() % 2;
+				Cut c = choose(p, policy, children, random);
+
+				if (f) {
+					PositionInfo info = p.info();
+					std::fprintf(f, "Position %sis %s, with distance to game end of %i.\n%s", p.list().c_str(),
+					             info.is_winning ? "winning" : "losing", info.dte, p.to_string().c_str());
+					std::fprintf(f, "Player %i cuts the position at (%i, %i).\n", player, c.first + 1, c.second + 1);
+				}
+
+				cuts.push_back(c);
+				p = p.cut(c);
+			}
+
+			// Whoever took the last square has lost
+			if (f) std::fprintf(f, "Player %i wins.\n", (cuts.size() % 2) ? 2 : 1);
+
+			return cuts;
+		}
+
+		// Play one game of self_play, returning its length
+		static int play(const Position& start, const SelfPlayOptions& options, Children& children, std::mt19937_64& random) {
+			std::uniform_real_distribution<double> chance(0, 1);
+			int length = 0;
+
+			for (Position p = start; p.height > 0; ++length) {
+				Policy policy = (length % 2) ? options.second : options.first;
+				bool mistake = options.mistake_rate > 0 && chance(random) < options.mistake_rate;
+
+				p = p.cut(mistake ? random_cut(p, random) : choose(p, policy, children, random));
+			}
+
+			return length;
+		}
+
+		void GameLengths::add(int length) {
+			if ((size_t) length >= lengths.size()) lengths.resize(length + 1);
+
+			lengths[length]++;
+			games++;
+			if (length % 2 == 0) first_player_wins++;
+		}
+
+		void GameLengths::merge(const GameLengths& other) {
+			if (lengths.size() < other.lengths.size()) lengths.resize(other.lengths.size());
+
+			for (size_t i = 0; i < other.lengths.size(); ++i)
+				lengths[i] += other.lengths[i];
+
+			games += other.games;
+			first_player_wins += other.first_player_wins;
+		}
+
+		double GameLengths::mean() const {
+			double total = 0;
+			for (size_t i = 0; i < lengths.size(); ++i) total += (double) i * lengths[i];
+
+			return games ? total / games : 0;
+		}
+
+		int GameLengths::percentile(double q) const {
+			uint64_t rank = (uint64_t) std::ceil(q * games);
+			uint64_t seen = 0;
+
+			for (size_t i = 0; i < lengths.size(); ++i) {
+				seen += lengths[i];
+				if (seen >= rank && seen > 0) return i;
+			}
+
+			return 0;
+		}
+
+		std::vector<GameLengths> self_play(const std::vector<Position>& starts, const SelfPlayOptions& options) {
+			// Games a worker takes at a time
+			const uint64_t GAME_CHUNK = 256;
+
+			if (options.threads < 1) throw std::runtime_error(FILE_LINE"Self-play needs at least one thread");
+			bool needs_dte = options.first != Policy::RANDOM || options.second != Policy::RANDOM;
+			for (const Position& start : starts) check_start(start, needs_dte);
+
+			uint64_t total = starts.size() * options.games;
+			std::atomic<uint64_t> next { 0 };
+
+			std::vector<std::vector<GameLengths>> worker_lengths(options.threads, std::vector<GameLengths>(starts.size()));
+
+			// The first error of any worker, rethrown on the calling thread
+			std::exception_ptr error;
+			std::mutex error_mutex;
+
+			datastructs::WorkerPool pool(options.threads);
+
+			auto work = [&] (int worker) {
+				Children children;
+
+				try {
+					for (uint64_t begin; (begin = next.fetch_add(GAME_CHUNK, std::memory_order_relaxed)) < total; ) {
+						uint64_t end = std::min(begin + GAME_CHUNK, total);
+
+						for (uint64_t game = begin; game < end; ++game) {
+							size_t s = game / options.games;
+							std::mt19937_64 random(options.seed * 0x9E3779B97F4A7C15ULL + game);
+
+							worker_lengths[worker][s].add(play(starts[s], options, children, random));
+						}
+					}
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error) error = std::current_exception();
+					// Stop the other workers early
+					next = total;
+				}
+			};
+
+			pool.run(work);
+			if (error) std::rethrow_exception(error);
+
+			std::vector<GameLengths> ret(starts.size());
+
+			for (size_t s = 0; s < starts.size(); ++s) {
+				ret[s].start = starts[s];
+				for (const std::vector<GameLengths>& lengths : worker_lengths) ret[s].merge(lengths[s]);
+			}
+
+			return ret;
+		}
+
+		void print_lengths(const std::vector<GameLengths>& results, FILE* f) {
+			for (const GameLengths& result : results) {
+				std::fprintf(f, "%s| %llu games, first player wins %.4f, length mean %.3f, p50 %i, p90 %i, p99 %i, max %i\n",
+				             result.start.list().c_str(), (unsigned long long) result.games,
+				             result.games ? (double) result.first_player_wins / result.games : 0, result.mean(),
+				             result.percentile(0.5), result.percentile(0.9), result.percentile(0.99), result.percentile(1));
+
+				for (size_t length = 0; length < result.lengths.size(); ++length) {
+					if (result.lengths[length])
+						std::fprintf(f, "  %zu %llu\n", length, (unsigned long long) result.lengths[length]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef CHOMP_STRATEGY_H
+#define CHOMP_STRATEGY_H
+
+#include <position.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace Chomp {
+	namespace strategy {
+		/*
+		 * Move-selection policies and self-play over the solved tables, which should have been built with compute_dte (and
+		 * compute_winning_moves for TRICKIEST_RATIO, compute_best_moves to make winning replies a single lookup). A game
+		 * ends when a player takes the last square, the poisoned one, and loses, leaving the other the empty position.
+		 */
+
+		// How a player picks a cut from a losing position. From a winning one, every policy but RANDOM takes the quickest win
+		enum class Policy : uint8_t
+		{
+			LONGEST_DELAY,
+			TRICKIEST_RATIO,
+			RANDOM
+		};
+
+		/**
+		 * Children of a position and their infos, evaluated together with info_batch. Kept from move to move, so a game
+		 * only allocates while the positions grow
+		 */
+		struct Children {
+			std::vector<Cut> cuts;
+			std::vector<Position> positions;
+			std::vector<PositionInfo> infos;
+
+			void evaluate(const Position& p);
+		};
+
+		// From a winning position, the cut to the losing child with the smallest dte, the recorded one if the solver
+		// recorded one and otherwise the first in cut order; (-1, -1) from a losing position
+		Cut winning_cut_shortest_delay(const Position& p, Children& children);
+
+		// From a losing position, the cut to the child with the largest dte (the first in cut order on ties), holding off
+		// the loss longest; (-1, -1) from the empty position
+		Cut losing_cut_longest_delay(const Position& p, Children& children);
+
+		/**
+		 * From a losing position, the cut to the child on which the smallest fraction of the opponent's cuts win, so that
+		 * a random mistake is likeliest, with ties going to the larger dte; (-1, -1) from the empty position. Child counts
+		 * come from Position::num_winning_cuts, which scans unless the tables have them
+		 */
+		Cut losing_cut_trickiest_ratio(const Position& p, Children& children);
+
+		// The cut a player following policy takes from p, or (-1, -1) from the empty position
+		Cut choose(const Position& p, Policy policy, Children& children, std::mt19937_64& random);
+
+		/**
+		 * Play a game from start with both players following policy, printing each position and cut to f if it isn't null.
+		 * Throws if start is outside answered_region, as are the starts of self_play
+		 * @return The cuts, in order
+		 */
+		std::vector<Cut> play_game(const Position& start, Policy policy, FILE* f=nullptr);
+
+		struct SelfPlayOptions {
+			// Policies of the player to move from the start, and of the other
+			Policy first = Policy::LONGEST_DELAY;
+			Policy second = Policy::LONGEST_DELAY;
+			// Chance that a player takes a uniformly random cut instead of its policy's, without which every game from a
+			// start is the same
+			double mistake_rate = 0;
+			// Games per start
+			uint64_t games = 1000000;
+			// Each game's moves depend only on the seed and the game's index, however the games fall to the threads
+			uint64_t seed = 1;
+			int threads = 8;
+		};
+
+		// Distribution of the lengths, in cuts, of the games from one start
+		struct GameLengths {
+			Position start;
+			uint64_t games = 0;
+			uint64_t first_player_wins = 0;
+			// Number of games of each length, indexed by the length
+			std::vector<uint64_t> lengths;
+
+			void add(int length);
+			void merge(const GameLengths& other);
+
+			double mean() const;
+			// Length that a fraction q of the games didn't exceed
+			int percentile(double q) const;
+		};
+
+		/**
+		 * Play options.games games from each start, spread over options.threads threads (at least one), each accumulating
+		 * its own distributions
+		 * @return One distribution per start, in order
+		 */
+		std::vector<GameLengths> self_play(const std::vector<Position>& starts, const SelfPlayOptions& options);
+
+		// A summary line per start, followed by its length histogram
+		void print_lengths(const std::vector<GameLengths>& results, FILE* f);
+	}
+}
+
+#endif //CHOMP_STRATEGY_H
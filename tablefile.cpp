@@ -0,0 +1,331 @@
+#include <tablefile.hpp>
+#include <datastructs.hpp>
+#include <spill.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Chomp {
+	namespace tablefile {
+		static const size_t WRITE_BUFFER_SIZE = 1 << 22;
+
+		uint64_t checksum(const void* data, size_t size) {
+			const uint8_t* bytes = (const uint8_t*) data;
+			uint64_t hash = size;
+
+			size_t i = 0;
+			for (; i + 8 <= size; i += 8) {
+				uint64_t word;
+				memcpy(&word, bytes + i, 8);
+				hash = datastructs::XXH::XXH64(hash, word);
+			}
+
+			if (i < size) {
+				uint64_t word = 0;
+				memcpy(&word, bytes + i, size - i);
+				hash = datastructs::XXH::XXH64(hash, word);
+			}
+
+			return hash;
+		}
+
+		static void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+			while (value >= 0x80) {
+				out.push_back((uint8_t) (value | 0x80));
+				value >>= 7;
+			}
+
+			out.push_back((uint8_t) value);
+		}
+
+		bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+			value = 0;
+
+			for (int shift = 0; shift < 64 && in < end; shift += 7) {
+				uint8_t byte = *in++;
+				value |= (uint64_t) (byte & 0x7f) << shift;
+
+				if (!(byte & 0x80)) return true;
+			}
+
+			return false;
+		}
+
+		Writer::Writer(const char* filename, int max_squares, int bound_width, int bound_height, bool has_dte)
+			: filename(filename), temporary(std::string(filename) + ".tmp"), buffer(WRITE_BUFFER_SIZE) {
+			f = fopen(temporary.c_str(), "wb");
+			if (!f) throw std::runtime_error(FILE_LINE"Failed to open table file");
+
+			std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+			Header header = {};
+			memcpy(header.magic, HEADER_MAGIC, sizeof(header.magic));
+			header.version = VERSION;
+			header.hash_scheme = HASH_SCHEME_POLYNOMIAL;
+			header.max_squares = max_squares;
+			header.bound_width = bound_width;
+			header.bound_height = bound_height;
+			header.flags = has_dte ? FLAG_DTE : 0;
+			header.hash_prime = HASH_PRIME;
+			header.checksum = checksum(&header, offsetof(Header, checksum));
+
+			write(&header, sizeof(header));
+		}
+
+		Writer::~Writer() {
+			if (f) {
+				fclose(f);
+				std::remove(temporary.c_str());
+			}
+		}
+
+		void Writer::write(const void* data, size_t size) {
+			if (fwrite(data, 1, size, f) != size) throw std::runtime_error(FILE_LINE"Failed to write table file");
+			offset += size;
+		}
+
+		void Writer::align() {
+			static const char zeros[64] = {};
+			if (offset % 64) write(zeros, 64 - offset % 64);
+		}
+
+		void Writer::add_level(int n, const store::LevelEntries& entries) {
+			if (!index.empty() && index.back().n >= n)
+				throw std::runtime_error(FILE_LINE"Levels must be added in increasing order");
+
+			LevelIndex level = {};
+			level.n = n;
+			level.count = entries.size();
+			level.blocks = (entries.size() + BLOCK_KEYS - 1) / BLOCK_KEYS;
+
+			std::vector<uint64_t> first_keys(level.blocks);
+			std::vector<uint32_t> block_offsets(level.blocks);
+			std::vector<uint8_t> deltas;
+			std::vector<uint16_t> dtes(entries.size());
+
+			for (size_t i = 0; i < entries.size(); ++i) {
+				uint64_t key = entries[i].first;
+
+				if (i % BLOCK_KEYS == 0) {
+					first_keys[i / BLOCK_KEYS] = key;
+					block_offsets[i / BLOCK_KEYS] = deltas.size();
+				} else {
+					if (key <= entries[i - 1].first) throw std::runtime_error(FILE_LINE"Level entries must be sorted");
+					put_varint(deltas, key - entries[i - 1].first);
+				}
+
+				dtes[i] = entries[i].second.dte;
+			}
+
+			if (deltas.size() > UINT32_MAX) throw std::runtime_error(FILE_LINE"Level too large for a table file");
+
+			align();
+			uint64_t hash = 0;
+
+			auto write_column = [&] (const void* data, size_t size, uint64_t& column_offset) {
+				column_offset = offset;
+				write(data, size);
+				hash = datastructs::XXH::XXH64(hash, checksum(data, size));
+			};
+
+			write_column(first_keys.data(), first_keys.size() * sizeof(uint64_t), level.first_keys_offset);
+			write_column(block_offsets.data(), block_offsets.size() * sizeof(uint32_t), level.block_offsets_offset);
+			write_column(deltas.data(), deltas.size(), level.deltas_offset);
+			level.deltas_size = deltas.size();
+
+			// Keep the dte column aligned for the mapped reader
+			align();
+			write_column(dtes.data(), dtes.size() * sizeof(uint16_t), level.dtes_offset);
+
+			level.checksum = hash;
+
+			index.push_back(level);
+		}
+
+		void Writer::finish() {
+			align();
+
+			Footer footer = {};
+			footer.index_offset = offset;
+			footer.levels = index.size();
+			footer.index_checksum = checksum(index.data(), index.size() * sizeof(LevelIndex));
+			memcpy(footer.magic, FOOTER_MAGIC, sizeof(footer.magic));
+
+			write(index.data(), index.size() * sizeof(LevelIndex));
+			write(&footer, sizeof(footer));
+
+			bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+			ok = (fclose(f) == 0) && ok;
+			f = nullptr;
+
+			if (!ok || std::rename(temporary.c_str(), filename.c_str()) != 0)
+				throw std::runtime_error(FILE_LINE"Failed to write table file");
+		}
+
+		Table::Table(const char* filename, MapTableOptions options) {
+			int fd = open(filename, O_RDONLY);
+			if (fd < 0) throw std::runtime_error(FILE_LINE"Failed to open table file");
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header) + sizeof(Footer)) {
+				close(fd);
+				throw std::runtime_error(FILE_LINE"Not a table file");
+			}
+
+			size = st.st_size;
+			// Shared, so that every process mapping the file uses the same page cache pages
+			void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED | (options.populate ? MAP_POPULATE : 0), fd, 0);
+			close(fd);
+
+			if (mapped == MAP_FAILED) throw std::runtime_error(FILE_LINE"Failed to map table file");
+
+			// Only advice; kernels without huge pages for file mappings refuse it
+			if (options.hugepages) madvise(mapped, size, MADV_HUGEPAGE);
+			data = (const uint8_t*) mapped;
+
+			header = (const Header*) data;
+			const Footer* footer = (const Footer*) (data + size - sizeof(Footer));
+
+			if (memcmp(header->magic, HEADER_MAGIC, sizeof(HEADER_MAGIC)) || header->version != VERSION
+			    || header->checksum != checksum(header, offsetof(Header, checksum))
+			    || memcmp(footer->magic, FOOTER_MAGIC, sizeof(FOOTER_MAGIC))
+			    || footer->index_offset + footer->levels * sizeof(LevelIndex) + sizeof(Footer) != size) {
+				munmap(mapped, size);
+				throw std::runtime_error(FILE_LINE"Not a v2 table file, or truncated");
+			}
+
+			const LevelIndex* index = (const LevelIndex*) (data + footer->index_offset);
+			if (footer->index_checksum != checksum(index, footer->levels * sizeof(LevelIndex))) {
+				munmap(mapped, size);
+				throw std::runtime_error(FILE_LINE"Corrupt table index");
+			}
+
+			for (uint64_t i = 0; i < footer->levels; ++i) {
+				int n = index[i].n;
+				if (n < 0) continue;
+				if ((int) levels.size() <= n) levels.resize(n + 1, LevelIndex {});
+
+				levels[n] = index[i];
+			}
+		}
+
+		Table::~Table() {
+			if (data) munmap((void*) data, size);
+		}
+
+		bool Table::verify() const {
+			for (const LevelIndex& level : levels) {
+				if (level.count == 0) continue;
+
+				uint64_t hash = 0;
+				hash = datastructs::XXH::XXH64(hash, checksum(data + level.first_keys_offset, level.blocks * sizeof(uint64_t)));
+				hash = datastructs::XXH::XXH64(hash, checksum(data + level.block_offsets_offset, level.blocks * sizeof(uint32_t)));
+				hash = datastructs::XXH::XXH64(hash, checksum(data + level.deltas_offset, level.deltas_size));
+				hash = datastructs::XXH::XXH64(hash, checksum(data + level.dtes_offset, level.count * sizeof(uint16_t)));
+
+				if (hash != level.checksum) return false;
+			}
+
+			return true;
+		}
+
+		bool Table::find(uint64_t key, int n, int& dte) const {
+			if (n < 0 || n > max_level()) return false;
+
+			const LevelIndex& level = levels[n];
+			if (level.count == 0) return false;
+
+			const uint64_t* first_keys = (const uint64_t*) (data + level.first_keys_offset);
+			const uint32_t* block_offsets = (const uint32_t*) (data + level.block_offsets_offset);
+
+			// Last block starting at or before key. Keys are hashes, so interpolation finds it in a few probes
+			size_t b = spill::interpolation_search(first_keys, level.blocks, key);
+			if (b == level.blocks || first_keys[b] != key) {
+				if (b == 0) return false;
+				b--;
+			}
+
+			uint64_t i = b * BLOCK_KEYS;
+			uint64_t block_end = std::min<uint64_t>(i + BLOCK_KEYS, level.count);
+			uint64_t current = first_keys[b];
+
+			const uint8_t* in = data + level.deltas_offset + block_offsets[b];
+			const uint8_t* end = data + level.deltas_offset + level.deltas_size;
+
+			while (current < key && ++i < block_end) {
+				uint64_t delta;
+				if (!get_varint(in, end, delta)) return false;
+				current += delta;
+			}
+
+			if (current != key) return false;
+
+			dte = ((const uint16_t*) (data + level.dtes_offset))[i];
+			return true;
+		}
+
+		void Table::prefetch(uint64_t key, int n) const {
+			if (n < 0 || n > max_level() || levels[n].blocks < 2) return;
+
+			const LevelIndex& level = levels[n];
+			const uint64_t* first_keys = (const uint64_t*) (data + level.first_keys_offset);
+
+			// Where interpolation_search guesses first
+			uint64_t lo = first_keys[0], hi = first_keys[level.blocks - 1];
+			if (key <= lo || key > hi) return;
+
+			double fraction = (double) (key - lo) / (double) (hi - lo);
+			__builtin_prefetch(first_keys + (size_t) (fraction * (level.blocks - 1)));
+		}
+
+		bool is_table_file(const char* filename) {
+			FILE* f = fopen(filename, "rb");
+			if (!f) return false;
+
+			char magic[sizeof(HEADER_MAGIC)];
+			bool ret = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, HEADER_MAGIC, sizeof(magic));
+			fclose(f);
+
+			return ret;
+		}
+
+		void Table::load(map_type& map) const {
+			for (int n = 0; n <= max_level(); ++n) {
+				map.reserve(map.size() + levels[n].count);
+				for_each(n, [&] (uint64_t key, int dte) { map[key] = { .dte = dte }; });
+			}
+		}
+
+		void convert_legacy(const char* legacy_filename, const char* filename, int max_squares, int bound_width,
+		                    int bound_height, bool has_dte) {
+			map_type legacy;
+			store::read_map(legacy, legacy_filename);
+
+			Writer writer(filename, max_squares, bound_width, bound_height, has_dte);
+			size_t placed = 0;
+
+			for (int n = 1; n <= max_squares; ++n) {
+				store::LevelEntries entries;
+
+				get_positions_with_n_tiles(n, [&] (const Position& p) {
+					auto it = legacy.find(p.canonical_hash());
+					if (it != legacy.end()) entries.push_back(*it);
+				}, bound_width, bound_height, true /* only canonical positions */);
+
+				std::sort(entries.begin(), entries.end(), [] (const auto& a, const auto& b) { return a.first < b.first; });
+				placed += entries.size();
+
+				writer.add_level(n, entries);
+			}
+
+			if (placed != legacy.size())
+				throw std::runtime_error(FILE_LINE"Legacy table has positions outside the given bounds");
+
+			writer.finish();
+		}
+	}
+}
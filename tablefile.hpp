@@ -0,0 +1,181 @@
+#ifndef CHOMP_TABLEFILE_H
+#define CHOMP_TABLEFILE_H
+
+#include <position.hpp>
+#include <store.hpp>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Chomp {
+	namespace tablefile {
+		/*
+		 * v2 table file, little endian:
+		 *
+		 *   Header (64 bytes)
+		 *   Level sections, each 64-byte aligned:
+		 *     first key of each block of BLOCK_KEYS keys (uint64_t[blocks])
+		 *     offset of each block's deltas (uint32_t[blocks])
+		 *     deltas between consecutive keys of a block, as varints (the first key of a block has none)
+		 *     dte of each key, in key order (uint16_t[count])
+		 *   Level index (LevelIndex[levels])
+		 *   Footer (32 bytes)
+		 *
+		 * Keys within a level are sorted, so a lookup is an interpolation search over the block's first keys and at most
+		 * BLOCK_KEYS - 1 varint decodes, straight out of the mapped file.
+		 */
+		constexpr char HEADER_MAGIC[8] = { 'C', 'H', 'O', 'M', 'P', 'T', 'B', '2' };
+		constexpr char FOOTER_MAGIC[8] = { 'C', 'H', 'O', 'M', 'P', 'E', 'N', 'D' };
+		constexpr uint32_t VERSION = 2;
+		constexpr int BLOCK_KEYS = 64;
+
+		// Canonical polynomial hash of the rows, see hash_position
+		constexpr uint32_t HASH_SCHEME_POLYNOMIAL = 1;
+		constexpr uint64_t HASH_PRIME = 179424673;
+
+		constexpr uint32_t FLAG_DTE = 1;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t hash_scheme;
+			int32_t max_squares;
+			int32_t bound_width;
+			int32_t bound_height;
+			uint32_t flags;
+			uint64_t hash_prime;
+			uint64_t reserved[2];
+			// Of the bytes above
+			uint64_t checksum;
+		};
+
+		struct LevelIndex {
+			int32_t n;
+			uint32_t blocks;
+			uint64_t count;
+			uint64_t first_keys_offset;
+			uint64_t block_offsets_offset;
+			uint64_t deltas_offset;
+			uint64_t deltas_size;
+			uint64_t dtes_offset;
+			// Of the whole section
+			uint64_t checksum;
+		};
+
+		struct Footer {
+			uint64_t index_offset;
+			uint64_t levels;
+			// Of the level index
+			uint64_t index_checksum;
+			char magic[8];
+		};
+
+		static_assert(sizeof(Header) == 64 && sizeof(LevelIndex) == 64 && sizeof(Footer) == 32);
+
+		uint64_t checksum(const void* data, size_t size);
+
+		/**
+		 * Writes a v2 table one level at a time, in increasing order of n. Usable as a LevelWriter sink
+		 */
+		class Writer {
+		private:
+			FILE* f;
+			std::string filename, temporary;
+			uint64_t offset = 0;
+			std::vector<LevelIndex> index;
+			std::vector<char> buffer;
+
+			void write(const void* data, size_t size);
+			void align();
+		public:
+			Writer(const char* filename, int max_squares, int bound_width, int bound_height, bool has_dte);
+			// Abandons the file if finish() wasn't called
+			~Writer();
+
+			// @param entries Losing positions with n squares, sorted by key
+			void add_level(int n, const store::LevelEntries& entries);
+			// Write the index and footer, then move the file into place
+			void finish();
+		};
+
+		/**
+		 * Read-only view of a v2 table, mapped rather than loaded
+		 */
+		class Table {
+		private:
+			const uint8_t* data = nullptr;
+			size_t size = 0;
+			const Header* header = nullptr;
+			// Indexed by n; levels not in the file have count 0
+			std::vector<LevelIndex> levels;
+		public:
+			// Checks the header, index and footer, but not the sections (see verify)
+			explicit Table(const char* filename, MapTableOptions options={});
+			~Table();
+
+			Table(const Table&) = delete;
+			Table& operator=(const Table&) = delete;
+
+			const Header& get_header() const { return *header; }
+			int max_level() const { return (int) levels.size() - 1; }
+			bool has_dte() const { return header->flags & FLAG_DTE; }
+
+			// Check every section's checksum, reading the whole file
+			bool verify() const;
+
+			/**
+			 * Look up a canonical hash among the positions with n squares
+			 * @return Whether it is a losing position; sets dte if so
+			 */
+			bool find(uint64_t key, int n, int& dte) const;
+			// Start fetching the block key that find will look at first
+			void prefetch(uint64_t key, int n) const;
+
+			// Insert every entry into map
+			void load(map_type& map) const;
+			// Call f(key, dte) for each entry of level n, in key order
+			template <typename F>
+			void for_each(int n, F f) const;
+		};
+
+		/**
+		 * Convert a legacy (write_map) file. It has no level information, so every canonical position within the bounds is
+		 * enumerated to place its keys
+		 * @param has_dte Whether the legacy table was solved with compute_dte; its dtes are all 0 otherwise
+		 */
+		void convert_legacy(const char* legacy_filename, const char* filename, int max_squares, int bound_width,
+		                    int bound_height, bool has_dte);
+
+		bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value);
+
+		// Whether filename starts with a v2 table header
+		bool is_table_file(const char* filename);
+
+		template <typename F>
+		void Table::for_each(int n, F f) const {
+			if (n < 0 || n > max_level()) return;
+			const LevelIndex& level = levels[n];
+
+			const uint64_t* first_keys = (const uint64_t*) (data + level.first_keys_offset);
+			const uint16_t* dtes = (const uint16_t*) (data + level.dtes_offset);
+			const uint8_t* in = data + level.deltas_offset;
+			const uint8_t* end = in + level.deltas_size;
+
+			uint64_t key = 0;
+			for (uint64_t i = 0; i < level.count; ++i) {
+				if (i % BLOCK_KEYS == 0) {
+					key = first_keys[i / BLOCK_KEYS];
+				} else {
+					uint64_t delta;
+					if (!get_varint(in, end, delta)) throw std::runtime_error(FILE_LINE"Corrupt table section");
+					key += delta;
+				}
+
+				f(key, (int) dtes[i]);
+			}
+		}
+	}
+}
+
+#endif //CHOMP_TABLEFILE_H
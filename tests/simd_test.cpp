@@ -0,0 +1,133 @@
+// Checks that every SIMD kernel this CPU supports gives the scalar kernel's results on random positions, including the
+// empty position, positions MAX_HEIGHT rows tall, and positions wider than MAX_CONJUGATE_WIDTH
+
+#include <simd.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+using namespace Chomp;
+
+// Rows past the height are never read, so they are filled with garbage to catch kernels that do
+static const int GARBAGE = 77777;
+
+static std::mt19937 rng(1);
+
+static int random_below(int n) {
+	return std::uniform_int_distribution<int>(0, n - 1)(rng);
+}
+
+// Height of a random position, with the edges of the range made common
+static int random_height(int trial) {
+	switch (trial % 8) {
+		case 0: return 0;
+		case 1: return MAX_HEIGHT;
+		case 2: return random_below(12);
+		default: return random_below(MAX_HEIGHT + 1);
+	}
+}
+
+static int random_width(int trial) {
+	switch (trial % 5) {
+		case 0: return simd::MAX_CONJUGATE_WIDTH + 1 + random_below(500);
+		case 1: return 1 + random_below(12);
+		default: return 1 + random_below(150);
+	}
+}
+
+// Non-increasing rows from width, sometimes near their own conjugate so that both orientations come up
+static void random_rows(int* rows, int height, int width) {
+	for (int i = 0; i < height; ++i) {
+		rows[i] = width;
+		if (random_below(3) == 0) width = std::max(1, width - random_below(4));
+	}
+
+	std::fill(rows + height, rows + MAX_HEIGHT, GARBAGE);
+}
+
+static int failures = 0;
+
+static void fail(const simd::Kernels* kernels, const char* what, int height) {
+	if (failures++ < 10) std::printf("%s: %s differs at height %i\n", kernels->name, what, height);
+}
+
+static void check_position(const simd::Kernels* scalar, const simd::Kernels* kernels, const int* rows, int height) {
+	int want[MAX_HEIGHT], got[MAX_HEIGHT];
+
+	int want_height = scalar->conjugate(rows, height, want);
+	int got_height = kernels->conjugate(rows, height, got);
+	if (got_height != want_height || !std::equal(want, want + want_height, got)) fail(kernels, "conjugate", height);
+
+	if (kernels->orientation(rows, height) != scalar->orientation(rows, height)) fail(kernels, "orientation", height);
+	if (kernels->hash(rows, height) != scalar->hash(rows, height)) fail(kernels, "hash", height);
+	if (kernels->hash_conjugate(rows, height) != scalar->hash_conjugate(rows, height)) fail(kernels, "hash_conjugate", height);
+
+	if (height == 0) return;
+
+	int row = random_below(height), col = random_below(rows[row]);
+	want_height = scalar->cut(rows, height, row, col, want);
+	got_height = kernels->cut(rows, height, row, col, got);
+	if (got_height != want_height || !std::equal(want, want + want_height, got)) fail(kernels, "cut", height);
+}
+
+static void check_lanes(const simd::Kernels* scalar, const simd::Kernels* kernels, int trial) {
+	static simd::PositionLanes lanes;
+	int rows[MAX_HEIGHT];
+
+	lanes.height = std::max(1, random_height(trial));
+	lanes.count = 1 + random_below(simd::LANES);
+
+	int max_width = 0;
+	for (int lane = 0; lane < simd::LANES; ++lane) {
+		random_rows(rows, lanes.height, random_width(trial + lane));
+		max_width = std::max(max_width, rows[0]);
+
+		for (int i = 0; i < MAX_HEIGHT; ++i) lanes.rows[i][lane] = rows[i];
+	}
+
+	for (int cut = 0; cut < 8; ++cut) {
+		int row = random_below(lanes.height), col = random_below(max_width);
+
+		simd::LaneHashes want, got;
+		scalar->lane_cut_hashes(lanes, row, col, want);
+		kernels->lane_cut_hashes(lanes, row, col, got);
+
+		if (got.valid != want.valid || got.special != want.special) {
+			fail(kernels, "lane_cut_hashes masks", lanes.height);
+			continue;
+		}
+
+		for (int lane = 0; lane < lanes.count; ++lane) {
+			if ((want.valid & ~want.special) >> lane & 1 && got.hashes[lane] != want.hashes[lane])
+				fail(kernels, "lane_cut_hashes", lanes.height);
+		}
+	}
+}
+
+int main() {
+	const int TRIALS = 20000;
+
+	const simd::Kernels* scalar = simd::get_kernels("scalar");
+
+	for (const char* name : { "avx2", "avx512" }) {
+		const simd::Kernels* kernels = simd::get_kernels(name);
+
+		if (!kernels) {
+			std::printf("%s: not supported here, skipped\n", name);
+			continue;
+		}
+
+		int rows[MAX_HEIGHT];
+		for (int trial = 0; trial < TRIALS; ++trial) {
+			int height = random_height(trial);
+			random_rows(rows, height, random_width(trial));
+
+			check_position(scalar, kernels, rows, height);
+			check_lanes(scalar, kernels, trial);
+		}
+
+		std::printf("%s: checked %i positions and lane groups\n", name, TRIALS);
+	}
+
+	return failures ? 1 : 0;
+}